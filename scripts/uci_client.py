@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Drive UCI sessions on a "chess server" socket.
+
+    scripts/uci_client.py SOCKET [-n SESSIONS] [-t TIMEOUT] [COMMAND ...]
+
+Commands come from the arguments, or from stdin, one per line. Every
+session sends the same commands in order and waits for the reply that
+ends each one (uciok, readyok, bestmove, or nodes for "go perft"), so
+the output shows complete searches. "go ponder" and "go infinite" do not
+wait; the "ponderhit" or "stop" that follows waits for their bestmove.
+A "sleep SECONDS" line pauses the session. Lines are prefixed with the session
+number when more than one session runs. Exits non-zero if a session
+fails or times out.
+"""
+
+import argparse
+import socket
+import sys
+import threading
+import time
+
+print_lock = threading.Lock()
+
+
+def expected_reply(command):
+    if command == "uci":
+        return "uciok"
+    if command == "isready":
+        return "readyok"
+    if command.startswith("go perft"):
+        return "nodes"
+    if command.startswith("go"):
+        return "bestmove"
+    return None
+
+
+def is_open_search(command):
+    words = command.split()
+    return words[:1] == ["go"] and ("ponder" in words or "infinite" in words)
+
+
+def run_session(index, path, commands, timeout, prefix, results):
+    try:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.settimeout(timeout)
+        sock.connect(path)
+        reader = sock.makefile("r", encoding="ascii", newline="\n")
+        start = time.monotonic()
+        open_search = False             # a go ponder / go infinite awaits its bestmove
+
+        for command in commands:
+            if command.startswith("sleep "):
+                time.sleep(float(command.split()[1]))
+                continue
+            sock.sendall((command + "\n").encode("ascii"))
+            reply = expected_reply(command)
+            if is_open_search(command):
+                open_search, reply = True, None
+            elif command in ("ponderhit", "stop") and open_search:
+                open_search, reply = False, "bestmove"
+            while reply:
+                line = reader.readline()
+                if not line:
+                    raise ConnectionError("server closed the session")
+                line = line.rstrip("\n")
+                with print_lock:
+                    print(prefix.format(index) + line, flush=True)
+                if line.split(" ", 1)[0] == reply:
+                    break
+
+        sock.sendall(b"quit\n")
+        sock.close()
+        results[index] = time.monotonic() - start
+    except (OSError, ConnectionError) as error:
+        with print_lock:
+            print(prefix.format(index) + "error: %s" % error, file=sys.stderr, flush=True)
+        results[index] = None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="UCI client for chess server mode")
+    parser.add_argument("socket")
+    parser.add_argument("commands", nargs="*")
+    parser.add_argument("-n", "--sessions", type=int, default=1)
+    parser.add_argument("-t", "--timeout", type=float, default=60.0)
+    args = parser.parse_intermixed_args()
+
+    commands = args.commands or [line.strip() for line in sys.stdin if line.strip()]
+    commands = [c for c in commands if c != "quit"]
+    prefix = "[{}] " if args.sessions > 1 else ""
+
+    results = [None] * args.sessions
+    threads = [threading.Thread(target=run_session,
+                                args=(i, args.socket, commands, args.timeout, prefix, results))
+               for i in range(args.sessions)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    failed = sum(1 for r in results if r is None)
+    print("%d sessions, %d failed, %.2f s" % (args.sessions, failed, time.monotonic() - start),
+          file=sys.stderr)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,358 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+
+// ----------------- EPD batch analysis -----------------
+
+/*
+ * chess epd <file> [depth N] [movetime MS] [threads N] [out FILE] [format csv|jsonl]
+ *
+ * Positions are read one line at a time by whichever worker is free, so the
+ * input is streamed and never held in memory. Each worker owns its Board
+ * and (thread-local) search state; all of them share the transposition
+ * table. Results are written as soon as a position finishes, so rows come
+ * out in completion order with the input line number as the key.
+ */
+
+#define EPD_MAX_MOVES 8
+#define EPD_LINE_MAX 4096
+#define BATCH_DEFAULT_DEPTH 6
+#define BATCH_STACK_SIZE (32u << 20)
+
+typedef struct {
+    Board board;
+    char id[128];
+    char bm[EPD_MAX_MOVES][SAN_MAX + 2];
+    char am[EPD_MAX_MOVES][SAN_MAX + 2];
+    int bmCount;
+    int amCount;
+} EpdPosition;
+
+typedef struct {
+    FILE* in;
+    FILE* out;
+    bool jsonl;
+    SearchLimits limits;
+
+    pthread_mutex_t inLock;
+    int lineNo;
+
+    pthread_mutex_t outLock;
+    int analysed, passed, failed, errors;
+} BatchJob;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// SAN without check marks and annotations, for comparing bm/am operands
+static void stripSAN(char* s) {
+    size_t n = strlen(s);
+    while (n > 0 && strchr("+#!?", s[n - 1])) {
+        s[--n] = '\0';
+    }
+}
+
+static void copyOperand(char* dst, size_t size, const char* src, size_t len) {
+    if (len >= size) len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/*
+ * EPD: four FEN fields, then "opcode operands;" operations. Full FEN lines
+ * (with clocks) are accepted too. Only bm, am, id and hmvc are used.
+ */
+static bool parseEpd(const char* line, EpdPosition* pos) {
+    memset(pos, 0, sizeof(*pos));
+
+    const char* p = line;
+    char fen[EPD_LINE_MAX];
+    size_t fenLen = 0;
+    for (int field = 0; field < 4; field++) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) return false;
+        while (*p && *p != ' ' && *p != '\t' && fenLen < sizeof(fen) - 2) {
+            fen[fenLen++] = *p++;
+        }
+        fen[fenLen++] = ' ';
+    }
+
+    // optional FEN clocks
+    int halfmove = 0;
+    while (*p == ' ' || *p == '\t') p++;
+    if (isdigit((unsigned char)*p)) {
+        halfmove = (int)strtol(p, (char**)&p, 10);
+        while (*p == ' ' || *p == '\t') p++;
+        if (isdigit((unsigned char)*p)) strtol(p, (char**)&p, 10);
+    }
+    snprintf(fen + fenLen, sizeof(fen) - fenLen, "%d 1", halfmove);
+
+    if (!parseFEN(&pos->board, fen))
+        return false;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ';') p++;
+        if (!*p || *p == '\n' || *p == '\r') break;
+
+        const char* opcode = p;
+        while (*p && !isspace((unsigned char)*p) && *p != ';') p++;
+        size_t opLen = (size_t)(p - opcode);
+
+        // operands up to the ';' (which may sit inside a quoted string)
+        while (*p && *p != ';') {
+            while (*p == ' ' || *p == '\t') p++;
+            if (!*p || *p == ';' || *p == '\n' || *p == '\r') break;
+
+            const char* operand = p;
+            size_t len;
+            if (*p == '"') {
+                operand = ++p;
+                while (*p && *p != '"') p++;
+                len = (size_t)(p - operand);
+                if (*p) p++;
+            } else {
+                while (*p && !isspace((unsigned char)*p) && *p != ';') p++;
+                len = (size_t)(p - operand);
+            }
+
+            if (opLen == 2 && !strncmp(opcode, "bm", 2) && pos->bmCount < EPD_MAX_MOVES) {
+                copyOperand(pos->bm[pos->bmCount], sizeof(pos->bm[0]), operand, len);
+                stripSAN(pos->bm[pos->bmCount++]);
+            } else if (opLen == 2 && !strncmp(opcode, "am", 2) && pos->amCount < EPD_MAX_MOVES) {
+                copyOperand(pos->am[pos->amCount], sizeof(pos->am[0]), operand, len);
+                stripSAN(pos->am[pos->amCount++]);
+            } else if (opLen == 2 && !strncmp(opcode, "id", 2)) {
+                copyOperand(pos->id, sizeof(pos->id), operand, len);
+            } else if (opLen == 4 && !strncmp(opcode, "hmvc", 4)) {
+                pos->board.halfmoveClock = atoi(operand);
+            }
+        }
+    }
+    return true;
+}
+
+// A bm/am operand may be SAN ("Nf3", "exd5") or coordinate notation ("g1f3").
+static bool moveMatches(const char* expected, const char* san, const char* uci) {
+    return !strcmp(expected, san) || !strcmp(expected, uci);
+}
+
+// Next non-empty, non-comment line; false at end of input.
+static bool nextLine(BatchJob* job, char* line, size_t size, int* lineNo) {
+    bool found = false;
+    pthread_mutex_lock(&job->inLock);
+    while (fgets(line, (int)size, job->in)) {
+        job->lineNo++;
+        const char* p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p && *p != '#') {
+            *lineNo = job->lineNo;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&job->inLock);
+    return found;
+}
+
+static void writeCsvString(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"') fputc('"', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+static void writeJsonString(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', out);
+        if ((unsigned char)*s >= 0x20) fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void writeResult(BatchJob* job, int lineNo, const EpdPosition* pos, const char* uci,
+                        const char* san, const SearchResult* res, const char* verdict) {
+    bool mate = res->score >= MATE_BOUND || res->score <= -MATE_BOUND;
+    int mateIn = res->score > 0 ? (MATE_SCORE - res->score + 1) / 2 : -(MATE_SCORE + res->score) / 2;
+    FILE* out = job->out;
+
+    if (job->jsonl) {
+        fprintf(out, "{\"line\":%d,\"id\":", lineNo);
+        writeJsonString(out, pos->id);
+        fprintf(out, ",\"bestmove\":\"%s\",\"san\":\"%s\",", uci, san);
+        if (mate)
+            fprintf(out, "\"score_mate\":%d,", mateIn);
+        else
+            fprintf(out, "\"score_cp\":%d,", res->score);
+        fprintf(out, "\"depth\":%d,\"seldepth\":%d,\"nodes\":%llu,\"time_ms\":%lld,\"result\":\"%s\"}\n",
+                res->depth, res->selDepth, (unsigned long long)res->nodes,
+                (long long)res->timeMs, verdict);
+    } else {
+        fprintf(out, "%d,", lineNo);
+        writeCsvString(out, pos->id);
+        fprintf(out, ",%s,%s,", uci, san);
+        if (mate)
+            fprintf(out, ",%d,", mateIn);
+        else
+            fprintf(out, "%d,,", res->score);
+        fprintf(out, "%d,%d,%llu,%lld,%s\n", res->depth, res->selDepth,
+                (unsigned long long)res->nodes, (long long)res->timeMs, verdict);
+    }
+    fflush(out);
+}
+
+static void* batchWorker(void* arg) {
+    BatchJob* job = (BatchJob*)arg;
+    char line[EPD_LINE_MAX];
+    int lineNo;
+
+    clearHeuristics();
+
+    while (nextLine(job, line, sizeof(line), &lineNo)) {
+        EpdPosition pos;
+        if (!parseEpd(line, &pos)) {
+            pthread_mutex_lock(&job->outLock);
+            job->errors++;
+            fprintf(stderr, "line %d: cannot parse position\n", lineNo);
+            pthread_mutex_unlock(&job->outLock);
+            continue;
+        }
+
+        resetKeyHistory();
+        SearchResult res;
+        Move best = findBestMove(&pos.board, &job->limits, &res);
+
+        char uci[6] = "0000";
+        char san[SAN_MAX] = "-";
+        const char* verdict = "none";
+        if (best.from >= 0) {
+            moveToString(best, uci);
+            moveToSAN(&pos.board, best, san);
+
+            if (pos.bmCount || pos.amCount) {
+                char bare[SAN_MAX];
+                strcpy(bare, san);
+                stripSAN(bare);
+                bool ok = pos.bmCount == 0;
+                for (int i = 0; i < pos.bmCount; i++) {
+                    if (moveMatches(pos.bm[i], bare, uci)) ok = true;
+                }
+                for (int i = 0; i < pos.amCount; i++) {
+                    if (moveMatches(pos.am[i], bare, uci)) ok = false;
+                }
+                verdict = ok ? "pass" : "fail";
+            }
+        }
+
+        pthread_mutex_lock(&job->outLock);
+        job->analysed++;
+        if (!strcmp(verdict, "pass")) job->passed++;
+        if (!strcmp(verdict, "fail")) job->failed++;
+        writeResult(job, lineNo, &pos, uci, san, &res, verdict);
+        pthread_mutex_unlock(&job->outLock);
+    }
+    return NULL;
+}
+
+int runBatch(int argc, char** argv) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: chess epd <file> [depth N] [movetime MS] [nodes N] [threads N] "
+                        "[out FILE] [format csv|jsonl] [deterministic 0|1]\n");
+        return 1;
+    }
+
+    BatchJob job;
+    memset(&job, 0, sizeof(job));
+    job.limits.silent = true;
+    job.limits.multiPV = 1;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    const char* outPath = NULL;
+    const char* format = NULL;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "depth"))         job.limits.depth = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "movetime")) job.limits.moveTimeMs = atoll(argv[i + 1]);
+        else if (!strcmp(argv[i], "nodes"))    job.limits.nodes = strtoull(argv[i + 1], NULL, 10);
+        else if (!strcmp(argv[i], "threads"))  threads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "out"))      outPath = argv[i + 1];
+        else if (!strcmp(argv[i], "format"))   format = argv[i + 1];
+        else if (!strcmp(argv[i], "deterministic")) job.limits.deterministic = atoi(argv[i + 1]) != 0;
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!job.limits.depth && !job.limits.moveTimeMs && !job.limits.nodes)
+        job.limits.depth = BATCH_DEFAULT_DEPTH;
+    if (threads < 1) threads = 1;
+    // workers share the TT, so only one of them can reproduce its results
+    if (job.limits.deterministic && threads > 1) {
+        fprintf(stderr, "deterministic: using 1 thread\n");
+        threads = 1;
+    }
+
+    if (format)
+        job.jsonl = !strcmp(format, "jsonl");
+    else if (outPath)
+        job.jsonl = strstr(outPath, ".json") != NULL;
+
+    job.in = strcmp(argv[0], "-") ? fopen(argv[0], "r") : stdin;
+    if (!job.in) {
+        fprintf(stderr, "cannot open %s\n", argv[0]);
+        return 1;
+    }
+    job.out = outPath ? fopen(outPath, "w") : stdout;
+    if (!job.out) {
+        fprintf(stderr, "cannot create %s\n", outPath);
+        return 1;
+    }
+    if (!job.jsonl)
+        fprintf(job.out, "line,id,bestmove,san,score_cp,score_mate,depth,seldepth,nodes,time_ms,result\n");
+
+    pthread_mutex_init(&job.inLock, NULL);
+    pthread_mutex_init(&job.outLock, NULL);
+
+    // deep recursion plus the thread-local search tables need a large stack
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, BATCH_STACK_SIZE);
+
+    double start = nowSeconds();
+    pthread_t* workers = (pthread_t*) calloc((size_t)threads, sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], &attr, batchWorker, &job) == 0)
+            started++;
+        else
+            break;
+    }
+    if (started == 0)
+        batchWorker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    pthread_attr_destroy(&attr);
+
+    fprintf(stderr, "%d positions in %.1fs on %d threads: %d passed, %d failed, %d unparsable\n",
+            job.analysed, nowSeconds() - start, started ? started : 1,
+            job.passed, job.failed, job.errors);
+
+    if (job.in != stdin) fclose(job.in);
+    if (job.out != stdout) fclose(job.out);
+    pthread_mutex_destroy(&job.inLock);
+    pthread_mutex_destroy(&job.outLock);
+    return 0;
+}
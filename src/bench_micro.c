@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitboard.h"
+
+/*
+ * Kernel micro-benchmarks ("make bench_micro"). Each kernel runs over a
+ * fixed corpus; the number of corpus passes is calibrated once so a run
+ * takes about the requested time, then the same work is repeated and the
+ * median is reported. Output is one CSV (or JSON) line per kernel.
+ *
+ *   bench-micro [runs N] [ms N] [tag TEXT] [format csv|jsonl]
+ */
+
+static const char* corpus[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "r2q1rk1/ppp2ppp/2np1n2/2b1p1B1/2B1P1b1/2NP1N2/PPP2PPP/R2Q1RK1 w - - 0 8",
+    "2r3k1/pp3ppp/4p3/3pP3/3P4/P1R2N2/1P3PPP/6K1 b - - 0 25",
+    "8/5pk1/6p1/8/8/3Q4/5PPP/6K1 w - - 0 1",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "3r2k1/1p3ppp/p1n5/2p1q3/4P3/1PN1Q1P1/P4P1P/3R2K1 b - - 3 24",
+};
+
+#define CORPUS_SIZE ((int)(sizeof(corpus) / sizeof(corpus[0])))
+#define MAX_RUNS 101
+
+static Board boards[CORPUS_SIZE];
+static Move corpusMoves[CORPUS_SIZE][256];
+static uint64_t corpusMoveCount[CORPUS_SIZE];
+
+// Results are folded in here so the compiler cannot drop the work.
+static volatile uint64_t sink;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ----------------- Kernels -----------------
+// Each runs one pass over the corpus and returns the number of operations.
+
+static uint64_t kernelMovegen(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        Move moves[256];
+        uint64_t count = 0;
+        generateLegalMovesToArray(&boards[i], moves, &count, 256);
+        acc += count;
+    }
+    sink += acc;
+    return CORPUS_SIZE;
+}
+static uint64_t kernelMakeUnmake(void) {
+    uint64_t ops = 0, acc = 0;
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        Board* b = &boards[i];
+        for (uint64_t m = 0; m < corpusMoveCount[i]; m++) {
+            Undo u;
+            applyMove(b, corpusMoves[i][m], &u);
+            acc += b->key;
+            unmakeMove(b, &u);
+        }
+        ops += corpusMoveCount[i];
+    }
+    sink += acc;
+    return ops;
+}
+static uint64_t kernelIsAttacked(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        for (int sq = 0; sq < 64; sq++) {
+            acc += isAttacked(&boards[i], sq, boards[i].mover);
+        }
+    }
+    sink += acc;
+    return (uint64_t)CORPUS_SIZE * 64;
+}
+static uint64_t kernelEvaluate(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        acc += (uint64_t)evaluate(&boards[i]);
+    }
+    sink += acc;
+    return CORPUS_SIZE;
+}
+static uint64_t kernelScoreMove(void) {
+    uint64_t ops = 0, acc = 0;
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        for (uint64_t m = 0; m < corpusMoveCount[i]; m++) {
+            acc += (uint64_t)scoreMove(&boards[i], &corpusMoves[i][m], 1);
+        }
+        ops += corpusMoveCount[i];
+    }
+    sink += acc;
+    return ops;
+}
+
+static const struct {
+    const char* name;
+    uint64_t (*run)(void);
+} kernels[] = {
+    { "movegen",    kernelMovegen },
+    { "makeunmake", kernelMakeUnmake },
+    { "isattacked", kernelIsAttacked },
+    { "evaluate",   kernelEvaluate },
+    { "scoremove",  kernelScoreMove },
+};
+
+static int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+    int runs = 15;
+    double runMs = 50.0;
+    const char* tag = "";
+    bool jsonl = false;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "runs"))        runs = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "ms"))     runMs = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "tag"))    tag = argv[i + 1];
+        else if (!strcmp(argv[i], "format")) jsonl = !strcmp(argv[i + 1], "jsonl");
+        else {
+            fprintf(stderr, "usage: bench-micro [runs N] [ms N] [tag TEXT] [format csv|jsonl]\n");
+            return 1;
+        }
+    }
+    if (runs < 1) runs = 1;
+    if (runs > MAX_RUNS) runs = MAX_RUNS;
+    if (runMs <= 0) runMs = 50.0;
+
+    initAttackTables();
+    evalResetParams();
+    clearHeuristics();
+    for (int i = 0; i < CORPUS_SIZE; i++) {
+        if (!parseFEN(&boards[i], corpus[i])) {
+            fprintf(stderr, "bad corpus position %d\n", i);
+            return 1;
+        }
+        generateLegalMovesToArray(&boards[i], corpusMoves[i], &corpusMoveCount[i], 256);
+    }
+
+    if (!jsonl)
+        printf("tag,kernel,ops,runs,median_ns,min_ns,max_ns,calls_per_s\n");
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        // calibrate: double the passes until a run takes a tenth of the target
+        uint64_t passes = 1;
+        for (;;) {
+            double start = nowSeconds();
+            for (uint64_t p = 0; p < passes; p++) kernels[k].run();
+            double elapsed = nowSeconds() - start;
+            if (elapsed * 1000.0 >= runMs / 10.0 || passes >= ((uint64_t)1 << 40)) {
+                double perPass = elapsed / passes;
+                passes = perPass > 0 ? (uint64_t)(runMs / 1000.0 / perPass) + 1 : passes;
+                break;
+            }
+            passes *= 2;
+        }
+
+        double nsPerOp[MAX_RUNS];
+        uint64_t ops = 0;
+        for (int r = 0; r < runs; r++) {
+            ops = 0;
+            double start = nowSeconds();
+            for (uint64_t p = 0; p < passes; p++) ops += kernels[k].run();
+            nsPerOp[r] = (nowSeconds() - start) * 1e9 / (double)ops;
+        }
+        qsort(nsPerOp, (size_t)runs, sizeof(double), compareDouble);
+        double median = runs % 2 ? nsPerOp[runs / 2] : (nsPerOp[runs / 2 - 1] + nsPerOp[runs / 2]) / 2.0;
+
+        if (jsonl) {
+            printf("{\"tag\":\"%s\",\"kernel\":\"%s\",\"ops\":%llu,\"runs\":%d,\"median_ns\":%.3f,"
+                   "\"min_ns\":%.3f,\"max_ns\":%.3f,\"calls_per_s\":%.0f}\n",
+                   tag, kernels[k].name, (unsigned long long)ops, runs, median,
+                   nsPerOp[0], nsPerOp[runs - 1], 1e9 / median);
+        } else {
+            printf("%s,%s,%llu,%d,%.3f,%.3f,%.3f,%.0f\n", tag, kernels[k].name,
+                   (unsigned long long)ops, runs, median, nsPerOp[0], nsPerOp[runs - 1], 1e9 / median);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -7,98 +7,22 @@
 #include <inttypes.h>
 #include <assert.h>
 
-
-
-typedef uint64_t U64;
-
-// Defining structs for board, Move, MoveList and Undo moves.
-typedef struct {
-    U64 wp, wn, wb, wr, wq, wk;
-    U64 bp, bn, bb, br, bq, bk;
-
-    U64 whitePieces;
-    U64 blackPieces;
-    U64 occupied;
-
-    bool shortBlack;
-    bool longBlack;
-    bool shortWhite;
-    bool longWhite;
-    int enPassantSquare;
-
-    int mover;
-} Board;
-typedef struct {
-    int from;
-    int to;
-    int promotionPiece;
-    int score;
-} Move;
-typedef struct {
-    size_t size;
-    Move* moves;
-    size_t count;
-} MoveList;
-typedef struct {
-    int from;
-    int to;
-    int movedPieceCode;
-    int capturedPieceCode;
-    int capturedSquare;
-    bool prevShortBlack, prevLongBlack, prevShortWhite, prevLongWhite;
-    int prevEnPassant;
-    int prevMover;
-
-    int rookFromSq;
-    int rookToSq;
-    int rookPieceCode;
-
-    bool wasEnPassant;
-} Undo;
-
-// Enums
-enum {
-    WHITE = 0, BLACK = 8,
-    PAWN = 1, KNIGHT = 2,  BISHOP = 3,  ROOK = 4,  QUEEN = 5,  KING = 6,
-};
-
-#define COLOR_MASK 0b1000
-
-/*
- *  Helper
- *  pieceCode & 7 == piece type
- *  pieceCode & COLOR_MASK (8) == color
-*/
-
-// ----------------- small helpers -----------------
-
-static inline U64 bit(int sq) {
-    assert(sq >= 0 && sq < 64);
-    return 1ULL << sq;
-}
-
-static inline int rankOf(int sq) {
-    return sq >> 3;
-}
-static inline int fileOf(int sq) {
-    return sq & 7;
-}
-static inline int sq_index(int rank, int file) {
-    return rank * 8 + file;
-}
-// Removes least significant 1 bit
-static inline int pop_lsb(U64 *b) {
-    U64 bb = *b;
-    int idx = __builtin_ctzll(bb); // returns least significant 1
-    *b = bb & (bb - 1);
-    return idx;
-}
+#include "bitboard.h"
 
 // ----------------- attack tables -----------------
 
 U64 knightAttacks[64];
 U64 kingAttacks[64];
 U64 bishopAttacks[64];
+U64 pawnAttacks[2][64];
+U64 betweenMask[64][64];
+U64 lineMask[64][64];
+
+// Ray directions: the first four walk towards higher square indices,
+// the last four towards lower ones (see positiveRay / negativeRay).
+enum { DIR_N, DIR_E, DIR_NE, DIR_NW, DIR_S, DIR_W, DIR_SW, DIR_SE };
+static const int rayOffsets[8][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}, {-1, 0}, {0, -1}, {-1, -1}, {-1, 1}};
+static U64 rayMasks[8][64];
 
 const int knightOffsets[8][2] = {{-2, -1}, {-2, 1}, {-1, -2}, {-1, 2}, {1, -2}, {1, 2}, {2, -1}, {2, 1}};
 const int kingOffsets[8][2]   = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
@@ -142,7 +66,214 @@ void initAttackTables() {
         kingAttacks[sq] = kA;
         knightAttacks[sq] = nA;
 
+        for (int c = 0; c < 2; ++c) {
+            int rr = r + (c == 0 ? 1 : -1);
+            U64 pA = 0ULL;
+            if (insideFileRank(rr, f - 1)) pA |= bit(sq_index(rr, f - 1));
+            if (insideFileRank(rr, f + 1)) pA |= bit(sq_index(rr, f + 1));
+            pawnAttacks[c][sq] = pA;
+        }
+
+        for (int d = 0; d < 8; ++d) {
+            rayMasks[d][sq] = rayAttacksFrom(sq, rayOffsets[d][0], rayOffsets[d][1], 0ULL);
+        }
     }
+
+    // between / line masks for every pair of aligned squares
+    memset(betweenMask, 0, sizeof(betweenMask));
+    memset(lineMask, 0, sizeof(lineMask));
+    for (int sq = 0; sq < 64; ++sq) {
+        for (int d = 0; d < 8; ++d) {
+            int opposite = (d + 4) & 7;
+            U64 line = rayMasks[d][sq] | rayMasks[opposite][sq] | bit(sq);
+            U64 between = 0ULL;
+            int r = rankOf(sq), f = fileOf(sq);
+            while (1) {
+                r += rayOffsets[d][0]; f += rayOffsets[d][1];
+                if (!insideFileRank(r, f)) break;
+                int t = sq_index(r, f);
+                betweenMask[sq][t] = between;
+                lineMask[sq][t] = line;
+                between |= bit(t);
+            }
+        }
+    }
+
+    initZobrist();
+}
+
+// ----------------- Zobrist keys -----------------
+
+U64 zobristPiece[16][64];
+U64 zobristCastle[16];
+U64 zobristEnPassant[8];
+U64 zobristSide;
+
+// Cuckoo tables for hasUpcomingRepetition(): keys of every reversible
+// non-pawn move (piece on s1 <-> s2, side flipped) and the squares involved.
+static U64 cuckooKeys[8192];
+static int cuckooFrom[8192];
+static int cuckooTo[8192];
+
+static inline int cuckooH1(U64 key) { return (int)(key & 0x1fff); }
+static inline int cuckooH2(U64 key) { return (int)((key >> 16) & 0x1fff); }
+
+static U64 zobristRandom(U64* state) {
+    // xorshift64*, fixed seed so keys are identical on every run
+    U64 x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+static inline int castleRights(bool shortWhite, bool longWhite, bool shortBlack, bool longBlack) {
+    return (shortWhite ? 1 : 0) | (longWhite ? 2 : 0) | (shortBlack ? 4 : 0) | (longBlack ? 8 : 0);
+}
+static U64 pieceAttacksEmpty(int piece, int sq) {
+    switch (piece) {
+        case KNIGHT: return knightAttacks[sq];
+        case BISHOP: return bishopAttacks[sq];
+        case ROOK:   return rookAttacksFrom(sq, 0ULL);
+        case QUEEN:  return bishopAttacks[sq] | rookAttacksFrom(sq, 0ULL);
+        case KING:   return kingAttacks[sq];
+        default:     return 0ULL;
+    }
+}
+// Needs the attack tables; called at the end of initAttackTables().
+void initZobrist() {
+    U64 state = 0x9E3779B97F4A7C15ULL;
+
+    memset(zobristPiece, 0, sizeof(zobristPiece));
+    for (int piece = PAWN; piece <= KING; ++piece) {
+        for (int sq = 0; sq < 64; ++sq) {
+            zobristPiece[piece | WHITE][sq] = zobristRandom(&state);
+            zobristPiece[piece | BLACK][sq] = zobristRandom(&state);
+        }
+    }
+    for (int i = 0; i < 16; ++i) {
+        zobristCastle[i] = zobristRandom(&state);
+    }
+    for (int f = 0; f < 8; ++f) {
+        zobristEnPassant[f] = zobristRandom(&state);
+    }
+    zobristSide = zobristRandom(&state);
+
+    memset(cuckooKeys, 0, sizeof(cuckooKeys));
+    memset(cuckooFrom, 0, sizeof(cuckooFrom));
+    memset(cuckooTo, 0, sizeof(cuckooTo));
+    for (int piece = KNIGHT; piece <= KING; ++piece) {
+        for (int color = WHITE; color <= BLACK; color += BLACK) {
+            int code = piece | color;
+            for (int s1 = 0; s1 < 64; ++s1) {
+                for (int s2 = s1 + 1; s2 < 64; ++s2) {
+                    if (!(pieceAttacksEmpty(piece, s1) & bit(s2))) continue;
+
+                    U64 key = zobristPiece[code][s1] ^ zobristPiece[code][s2] ^ zobristSide;
+                    int from = s1, to = s2;
+                    int i = cuckooH1(key);
+                    while (1) {
+                        U64 tk = cuckooKeys[i]; cuckooKeys[i] = key; key = tk;
+                        int tf = cuckooFrom[i]; cuckooFrom[i] = from; from = tf;
+                        int tt = cuckooTo[i]; cuckooTo[i] = to; to = tt;
+                        if (key == 0) break;
+                        i = (i == cuckooH1(key)) ? cuckooH2(key) : cuckooH1(key);
+                    }
+                }
+            }
+        }
+    }
+}
+// The en-passant file only counts when a pawn of the side to move (capturer)
+// can take there, as in polyglotKey(); otherwise positions that differ only
+// by an unusable ep square would not repeat.
+static inline U64 enPassantKey(const Board* b, int capturer) {
+    int ep = b->enPassantSquare;
+    if (ep < 0)
+        return 0;
+    return (pawnsOf(b, capturer) & pawnAttacks[colorIndex(capturer ^ COLOR_MASK)][ep]) ? zobristEnPassant[fileOf(ep)] : 0;
+}
+U64 computeKey(const Board* b) {
+    U64 key = 0ULL;
+    U64 occ = b->occupied;
+    while (occ) {
+        int sq = pop_lsb(&occ);
+        key ^= zobristPiece[pieceAt(b, sq)][sq];
+    }
+    key ^= zobristCastle[castleRights(b->shortWhite, b->longWhite, b->shortBlack, b->longBlack)];
+    key ^= enPassantKey(b, b->mover);
+    if (b->mover == BLACK) {
+        key ^= zobristSide;
+    }
+    return key;
+}
+
+// ----------------- Key history / repetition -----------------
+
+_Thread_local U64 keyHistory[KEY_HISTORY_SIZE];
+_Thread_local int keyHistoryCount = 0;
+
+void resetKeyHistory() {
+    keyHistoryCount = 0;
+}
+void pushKeyHistory(U64 key) {
+    assert(keyHistoryCount < KEY_HISTORY_SIZE);
+    keyHistory[keyHistoryCount++] = key;
+}
+void popKeyHistory() {
+    keyHistoryCount--;
+}
+// Only positions since the last irreversible move (halfmove clock) can repeat,
+// and only those with the same side to move, so the scan steps back by two.
+bool isRepetition(const Board* b) {
+    int limit = keyHistoryCount - b->halfmoveClock;
+    if (limit < 0) limit = 0;
+    for (int i = keyHistoryCount - 4; i >= limit; i -= 2) {
+        if (keyHistory[i] == b->key) return true;
+    }
+    return false;
+}
+static bool keyRepeatedBefore(int index, int limit) {
+    for (int i = index - 4; i >= limit; i -= 2) {
+        if (keyHistory[i] == keyHistory[index]) return true;
+    }
+    return false;
+}
+/*
+ * True if the side to move has a reversible move that reaches a position
+ * already in the history (cuckoo lookup of the key difference, see
+ * initZobrist). Inside the search tree any such cycle is a draw; at or
+ * before the root it must already have been repeated once.
+ */
+bool hasUpcomingRepetition(const Board* b, int ply) {
+    int end = b->halfmoveClock;
+    if (end > keyHistoryCount) end = keyHistoryCount;
+    if (end < 3) return false;
+
+    int limit = keyHistoryCount - b->halfmoveClock;
+    if (limit < 0) limit = 0;
+
+    for (int i = 3; i <= end; i += 2) {
+        int index = keyHistoryCount - i;
+        U64 moveKey = b->key ^ keyHistory[index];
+        int j = cuckooH1(moveKey);
+        if (cuckooKeys[j] != moveKey) {
+            j = cuckooH2(moveKey);
+            if (cuckooKeys[j] != moveKey) continue;
+        }
+
+        int s1 = cuckooFrom[j], s2 = cuckooTo[j];
+        if (betweenMask[s1][s2] & b->occupied) continue;
+
+        if (ply > i) return true;
+
+        // the piece making the cycle must belong to the side to move
+        int code = pieceAt(b, (b->occupied & bit(s1)) ? s1 : s2);
+        if ((code & COLOR_MASK) != b->mover) continue;
+
+        if (keyRepeatedBefore(index, limit)) return true;
+    }
+    return false;
 }
 
 // ----------------- Move List -----------------
@@ -239,257 +370,144 @@ U64 rayAttacksFrom(int sq, int dr, int df, U64 occupancy) {
     }
     return attacks;
 }
-bool isAttacked(Board board, int row, int col, int color){
-    int sq = sq_index(row, col);
-    int attackerColor = (color == WHITE) ? BLACK : WHITE;
-
-    // attacker bitboards
-    // U64 atkP = (attackerColor == WHITE) ? board.wp : board.bp;
-    U64 atkN = (attackerColor == WHITE) ? board.wn : board.bn;
-    U64 atkB = (attackerColor == WHITE) ? board.wb : board.bb;
-    U64 atkR = (attackerColor == WHITE) ? board.wr : board.br;
-    U64 atkQ = (attackerColor == WHITE) ? board.wq : board.bq;
-    U64 atkK = (attackerColor == WHITE) ? board.wk : board.bk;
-
-    // Knights
-    if (knightAttacks[sq] & atkN) {
-        return true;
+static inline U64 positiveRay(int dir, int sq, U64 occupancy) {
+    U64 attacks = rayMasks[dir][sq];
+    U64 blockers = attacks & occupancy;
+    if (blockers) {
+        attacks ^= rayMasks[dir][__builtin_ctzll(blockers)];
     }
-
-    // King
-    if (kingAttacks[sq] & atkK) {
-        return true;
-    }
-
-    int r = row, f = col;
-    if (attackerColor == WHITE) {
-        int pr = r - 1;
-        for (int df = -1; df <= 1; df += 2) {
-            int pf = f + df;
-            if (!insideFileRank(pr, pf)) {
-                continue;
-            }
-            int psq = sq_index(pr, pf);
-            if (board.wp & bit(psq)) {
-                return true;
-            }
-        }
-    } else {
-        int pr = r + 1;
-        for (int df = -1; df <= 1; df += 2) {
-            int pf = f + df;
-            if (!insideFileRank(pr, pf)) {
-                continue;
-            }
-            int psq = sq_index(pr, pf);
-            if (board.bp & bit(psq)) {
-                return true;
-            }
-        }
-    }
-
-    // Sliding: rook/queen (orthogonal)
-    U64 occ = board.occupied;
-    for (int i = 0; i < 4; ++i) {
-        int dr = rookOffsets[i][0];
-        int df = rookOffsets[i][1];
-        U64 rAtt = rayAttacksFrom(sq, dr, df, occ);
-        if (rAtt & (atkR | atkQ)) {
-            return true;
-        }
-    }
-
-    // Sliding: bishop/queen (diagonal)
-    for (int i = 0; i < 4; ++i) {
-        int dr = bishopOffsets[i][0];
-        int df = bishopOffsets[i][1];
-        U64 bAtt = rayAttacksFrom(sq, dr, df, occ);
-        if (bAtt & (atkB | atkQ)) {
-            return true;
-        }
+    return attacks;
+}
+static inline U64 negativeRay(int dir, int sq, U64 occupancy) {
+    U64 attacks = rayMasks[dir][sq];
+    U64 blockers = attacks & occupancy;
+    if (blockers) {
+        attacks ^= rayMasks[dir][63 - __builtin_clzll(blockers)];
     }
-
-    return false;
+    return attacks;
 }
-
-// ----------------- Move generation -----------------
-
-void addMoveToListFromTo(MoveList* mL, int fromSq, int toSq, int promo) {
-    Move m;
-    m.from = fromSq;
-    m.to = toSq;
-    m.promotionPiece = promo;
-    addMove(mL, m);
+U64 bishopAttacksFrom(int sq, U64 occupancy) {
+    return positiveRay(DIR_NE, sq, occupancy) | positiveRay(DIR_NW, sq, occupancy) |
+           negativeRay(DIR_SW, sq, occupancy) | negativeRay(DIR_SE, sq, occupancy);
+}
+U64 rookAttacksFrom(int sq, U64 occupancy) {
+    return positiveRay(DIR_N, sq, occupancy) | positiveRay(DIR_E, sq, occupancy) |
+           negativeRay(DIR_S, sq, occupancy) | negativeRay(DIR_W, sq, occupancy);
+}
+SPECIALIZED bool squareAttackedBy(const Board* b, int sq, int attacker) {
+    const int defender = attacker ^ COLOR_MASK;
+    U64 queens = queensOf(b, attacker);
+
+    return (knightAttacks[sq] & knightsOf(b, attacker))
+        || (kingAttacks[sq] & kingOf(b, attacker))
+        // a pawn of the defending color on sq would attack the attacker's pawns
+        || (pawnAttacks[colorIndex(defender)][sq] & pawnsOf(b, attacker))
+        || (rookAttacksFrom(sq, b->occupied) & (rooksOf(b, attacker) | queens))
+        || (bishopAttacksFrom(sq, b->occupied) & (bishopsOf(b, attacker) | queens));
+}
+// Whether the side opposing color attacks sq; one dispatch, like applyMove().
+bool isAttacked(const Board* b, int sq, int color) {
+    return color == WHITE ? squareAttackedBy(b, sq, BLACK) : squareAttackedBy(b, sq, WHITE);
 }
 
-void pawnMoves(Board* b, MoveList* mL, int sq) {
-    int colorBit = ( (b->wp & bit(sq)) ? WHITE : (b->bp & bit(sq)) ? BLACK : -1 );
-    if (colorBit == -1) {
-        return;
+SPECIALIZED void sideAttackInfo(const Board* b, AttackInfo* ai, int color) {
+    const int c = colorIndex(color);
+    const U64 occ = b->occupied;
+    const U64 own = piecesOf(b, color);
+    U64 pawns = pawnsOf(b, color);
+    U64 knights = knightsOf(b, color);
+    U64 bishops = bishopsOf(b, color);
+    U64 rooks = rooksOf(b, color);
+    U64 queens = queensOf(b, color);
+    U64 king = kingOf(b, color);
+    U64 a, all;
+
+    for (int p = 0; p < 7; ++p) {
+        ai->attackedBy[c][p] = 0ULL;
+        ai->mobility[c][p] = 0;
     }
 
-    int dir = (colorBit == WHITE) ? 1 : -1; 
-    int startRank = (colorBit == WHITE) ? 1 : 6;
-    int promotionRank = (colorBit == WHITE) ? 7 : 0;
-
-    int r = rankOf(sq), f = fileOf(sq);
-    int toR = r + dir;
-
-    if (insideFileRank(toR, f) && !(b->occupied & bit(sq_index(toR, f)))) {
-        int toSq = sq_index(toR, f);
-        if (toR == promotionRank) {
-            for (int p = 2; p <= 5; ++p) {
-                addMoveToListFromTo(mL, sq, toSq, p);
-            }
-        } else {
-            addMoveToListFromTo(mL, sq, toSq, 0);
-        }
-
-        int rr = r + 2*dir;
-        if (r == startRank && insideFileRank(rr, f) && !(b->occupied & bit(sq_index(rr, f)))) {
-            addMoveToListFromTo(mL, sq, sq_index(rr, f), 0);
-        }
+    const U64 notFileA = 0xfefefefefefefefeULL;
+    const U64 notFileH = 0x7f7f7f7f7f7f7f7fULL;
+    if (color == WHITE) {
+        a = ((pawns & notFileA) << 7) | ((pawns & notFileH) << 9);
+    } else {
+        a = ((pawns & notFileA) >> 9) | ((pawns & notFileH) >> 7);
     }
+    ai->attackedBy[c][PAWN] = a;
+    all = a;
 
-    for (int df = -1; df <= 1; df += 2) {
-        int tf = f + df;
-        if (!insideFileRank(toR, tf)) {
-            continue;
-        }
-        int toSq = sq_index(toR, tf);
-        int targetCode = findPieceCodeAt(b, toSq);
-        if (targetCode != 0) {
-            int targetColor = targetCode & COLOR_MASK;
-            if (targetColor != colorBit) {
-                if (toR == promotionRank) {
-                    for (int p = 2; p <= 5; ++p) addMoveToListFromTo(mL, sq, toSq, p);
-                } else {
-                    addMoveToListFromTo(mL, sq, toSq, 0);
-                }
-            }
-        } else {
-            if (b->enPassantSquare == toSq) {
-                int capRank = toR - dir;
-                int capSq = sq_index(capRank, tf);
-                int capCode = findPieceCodeAt(b, capSq);
-                if (capCode != 0 && (capCode & 7) == PAWN && (capCode & COLOR_MASK) != colorBit) {
-                    addMoveToListFromTo(mL, sq, toSq, 0);
-                }
-            }
-        }
-    }
-}
-void knightMoves(Board* b, MoveList* mL, int sq) {
-    int colorBit = ( (b->wn & bit(sq)) ? WHITE : (b->bn & bit(sq)) ? BLACK : -1 );
-    if (colorBit == -1) {
-        return;
-    }
-    U64 targets = knightAttacks[sq] & ~( (colorBit==WHITE) ? b->whitePieces : b->blackPieces );
-    U64 t = targets;
-    while (t) {
-        int to = pop_lsb(&t);
-        addMoveToListFromTo(mL, sq, to, 0);
+    while (knights) {
+        a = knightAttacks[pop_lsb(&knights)];
+        ai->attackedBy[c][KNIGHT] |= a;
+        ai->mobility[c][KNIGHT] += __builtin_popcountll(a & ~own);
     }
-}
-void slidingMoves(Board* b, MoveList* mL, int sq, const int directions[4][2], int dirCount) {
-    int pieceCode = findPieceCodeAt(b, sq);
-    if (pieceCode == 0) {
-        return;
+    while (bishops) {
+        a = bishopAttacksFrom(pop_lsb(&bishops), occ);
+        ai->attackedBy[c][BISHOP] |= a;
+        ai->mobility[c][BISHOP] += __builtin_popcountll(a & ~own);
     }
-    int colorBit = pieceCode & COLOR_MASK;
-    for (int i = 0; i < dirCount; ++i) {
-        int dr = directions[i][0];
-        int df = directions[i][1];
-        int r = rankOf(sq), f = fileOf(sq);
-        while (1) {
-            r += dr; f += df;
-            if (!insideFileRank(r, f)) break;
-            int to = sq_index(r, f);
-            int targetCode = findPieceCodeAt(b, to);
-            if (targetCode == 0) {
-                addMoveToListFromTo(mL, sq, to, 0);
-            } else {
-                int tcolor = targetCode & COLOR_MASK;
-                if (tcolor != colorBit) {
-                    addMoveToListFromTo(mL, sq, to, 0);
-                }
-                break;
-            }
-        }
+    while (rooks) {
+        a = rookAttacksFrom(pop_lsb(&rooks), occ);
+        ai->attackedBy[c][ROOK] |= a;
+        ai->mobility[c][ROOK] += __builtin_popcountll(a & ~own);
     }
-}
-void bishopMoves(Board* b, MoveList* mL, int sq) {
-    slidingMoves(b, mL, sq, bishopOffsets, 4);
-}
-void rookMoves(Board* b, MoveList* mL, int sq) {
-    slidingMoves(b, mL, sq, rookOffsets, 4);
-}
-void queenMoves(Board* b, MoveList* mL, int sq) {
-    bishopMoves(b, mL, sq);
-    rookMoves(b, mL, sq);
-}
-void kingMoves(Board* b, MoveList* mL, int sq) {
-    int pieceCode = findPieceCodeAt(b, sq);
-    if (pieceCode == 0) return;
-    int colorBit = pieceCode & COLOR_MASK;
-    U64 targets = kingAttacks[sq] & ~( (colorBit == WHITE) ? b->whitePieces : b->blackPieces );
-    U64 t = targets;
-    while (t) {
-        int to = pop_lsb(&t);
-        addMoveToListFromTo(mL, sq, to, 0);
+    while (queens) {
+        int sq = pop_lsb(&queens);
+        a = bishopAttacksFrom(sq, occ) | rookAttacksFrom(sq, occ);
+        ai->attackedBy[c][QUEEN] |= a;
+        ai->mobility[c][QUEEN] += __builtin_popcountll(a & ~own);
     }
 
-    // Castling (with attack checks)
-    if (colorBit == WHITE && sq == sq_index(0,4)) {
-
-        // King-side
-        if (b->shortWhite &&
-            !(b->occupied & bit(sq_index(0,5))) &&
-            !(b->occupied & bit(sq_index(0,6))) &&
-            !isAttacked(*b, 0, 4, WHITE) &&
-            !isAttacked(*b, 0, 5, WHITE) &&
-            !isAttacked(*b, 0, 6, WHITE))
-        {
-            addMoveToListFromTo(mL, sq, sq_index(0,6), 0);
-        }
+    ai->kingSq[c] = king ? __builtin_ctzll(king) : -1;
+    if (king) {
+        ai->attackedBy[c][KING] = kingAttacks[ai->kingSq[c]];
+    }
 
-        // Queen-side
-        if (b->longWhite &&
-            !(b->occupied & bit(sq_index(0,3))) &&
-            !(b->occupied & bit(sq_index(0,2))) &&
-            !(b->occupied & bit(sq_index(0,1))) &&
-            !isAttacked(*b, 0, 4, WHITE) &&
-            !isAttacked(*b, 0, 3, WHITE) &&
-            !isAttacked(*b, 0, 2, WHITE))
-        {
-            addMoveToListFromTo(mL, sq, sq_index(0,2), 0);
-        }
+    for (int p = KNIGHT; p <= KING; ++p) {
+        all |= ai->attackedBy[c][p];
     }
+    ai->attacked[c] = all;
+}
+// checkers and pins for the side to move
+SPECIALIZED void checksAndPins(const Board* b, AttackInfo* ai, int us) {
+    const int them = us ^ COLOR_MASK;
+    const U64 occ = b->occupied;
 
-    if (colorBit == BLACK && sq == sq_index(7,4)) {
+    ai->checkers = 0ULL;
+    ai->pinned = 0ULL;
 
-        if (b->shortBlack &&
-            !(b->occupied & bit(sq_index(7,5))) &&
-            !(b->occupied & bit(sq_index(7,6))) &&
-            !isAttacked(*b, 7, 4, BLACK) &&
-            !isAttacked(*b, 7, 5, BLACK) &&
-            !isAttacked(*b, 7, 6, BLACK))
-        {
-            addMoveToListFromTo(mL, sq, sq_index(7,6), 0);
-        }
+    int ksq = ai->kingSq[colorIndex(us)];
+    if (ksq < 0) {
+        return;
+    }
 
-        if (b->longBlack &&
-            !(b->occupied & bit(sq_index(7,3))) &&
-            !(b->occupied & bit(sq_index(7,2))) &&
-            !(b->occupied & bit(sq_index(7,1))) &&
-            !isAttacked(*b, 7, 4, BLACK) &&
-            !isAttacked(*b, 7, 3, BLACK) &&
-            !isAttacked(*b, 7, 2, BLACK))
-        {
-            addMoveToListFromTo(mL, sq, sq_index(7,2), 0);
+    U64 own = piecesOf(b, us);
+    U64 theirDiag = bishopsOf(b, them) | queensOf(b, them);
+    U64 theirOrtho = rooksOf(b, them) | queensOf(b, them);
+
+    ai->checkers = (knightAttacks[ksq] & knightsOf(b, them)) |
+                   (pawnAttacks[colorIndex(us)][ksq] & pawnsOf(b, them)) |
+                   (bishopAttacksFrom(ksq, occ) & theirDiag) |
+                   (rookAttacksFrom(ksq, occ) & theirOrtho);
+
+    U64 snipers = (bishopAttacks[ksq] & theirDiag) | (rookAttacksFrom(ksq, 0ULL) & theirOrtho);
+    while (snipers) {
+        int s = pop_lsb(&snipers);
+        U64 between = betweenMask[ksq][s] & occ;
+        if (between && !(between & (between - 1)) && (between & own)) {
+            ai->pinned |= between;
         }
     }
-
+}
+void computeAttackInfo(const Board* b, AttackInfo* ai) {
+    sideAttackInfo(b, ai, WHITE);
+    sideAttackInfo(b, ai, BLACK);
+    if (b->mover == WHITE) {
+        checksAndPins(b, ai, WHITE);
+    } else {
+        checksAndPins(b, ai, BLACK);
+    }
 }
 
 // ----------------- Make / Unmake Move -----------------
@@ -542,21 +560,35 @@ void placePieceAt(Board* b, int sq, int pieceCode) {
     }
     setPiece(b, sq, pieceCode);
 }
-bool applyMove(Board* b, Move mv, Undo* u) {
-    int fromSq   = mv.from;
-    int toSq     = mv.to;
-    int fromRank = fromSq / 8;
-    int toRank   = toSq   / 8;
-    int fromFile = fromSq % 8;
-    int toFile   = toSq   % 8;
+// Bitboard holding pieces of the given type and color.
+SPECIALIZED U64* pieceBoard(Board* b, int type, int color) {
+    switch (type) {
+        case PAWN:   return color == WHITE ? &b->wp : &b->bp;
+        case KNIGHT: return color == WHITE ? &b->wn : &b->bn;
+        case BISHOP: return color == WHITE ? &b->wb : &b->bb;
+        case ROOK:   return color == WHITE ? &b->wr : &b->br;
+        case QUEEN:  return color == WHITE ? &b->wq : &b->bq;
+        default:     return color == WHITE ? &b->wk : &b->bk;
+    }
+}
+SPECIALIZED U64* occupancyOf(Board* b, int color) {
+    return color == WHITE ? &b->whitePieces : &b->blackPieces;
+}
+
+SPECIALIZED bool applyMoveAs(Board* b, Move mv, Undo* u, int us) {
+    const int them = us ^ COLOR_MASK;
+    int fromSq = mv.from;
+    int toSq   = mv.to;
+    U64 fromBit = bit(fromSq);
+    U64 toBit   = bit(toSq);
 
     /* ================= SAVE UNDO STATE ================= */
 
     u->from = fromSq;
     u->to   = toSq;
 
-    u->movedPieceCode    = findPieceCodeAt(b, fromSq);
-    u->capturedPieceCode = findPieceCodeAt(b, toSq);
+    u->movedPieceCode    = pieceOfColorAt(b, fromBit, us);
+    u->capturedPieceCode = (b->occupied & toBit) ? pieceOfColorAt(b, toBit, them) : 0;
     u->capturedSquare    = toSq;
 
     u->prevShortWhite = b->shortWhite;
@@ -565,7 +597,10 @@ bool applyMove(Board* b, Move mv, Undo* u) {
     u->prevLongBlack  = b->longBlack;
 
     u->prevEnPassant = b->enPassantSquare;
-    u->prevMover     = b->mover;
+    const U64 prevEnPassantKey = enPassantKey(b, us);
+    u->prevMover     = us;
+    u->prevHalfmoveClock = b->halfmoveClock;
+    u->prevKey       = b->key;
 
     u->wasEnPassant  = false;
     u->rookFromSq   = -1;
@@ -576,81 +611,61 @@ bool applyMove(Board* b, Move mv, Undo* u) {
 
     int movingCode = u->movedPieceCode;
     if (movingCode == 0) return false;
+    int type = movingCode & 7;
 
-    int moverColor = movingCode & COLOR_MASK;
-    int dir = (moverColor == WHITE) ? 1 : -1;
-
-    /* ================= EN PASSANT CAPTURE ================= */
+    /* ================= CAPTURES ================= */
 
-    if ((movingCode & 7) == PAWN &&
-        fromFile != toFile &&
-        findPieceCodeAt(b, toSq) == 0 &&
-        b->enPassantSquare == toSq) {
-
-        u->wasEnPassant = true;
-
-        int capSq = toSq - dir * 8;
+    if (type == PAWN && toSq == b->enPassantSquare && !(b->occupied & toBit)) {
+        // a pawn moving to the empty en passant square is always a capture
+        int capSq = (us == WHITE) ? toSq - 8 : toSq + 8;
+        u->wasEnPassant      = true;
         u->capturedSquare    = capSq;
-        u->capturedPieceCode = findPieceCodeAt(b, capSq);
-
-        removePieceAt(b, capSq);
+        u->capturedPieceCode = pieceOfColorAt(b, bit(capSq), them);
     }
-
-    /* ================= NORMAL CAPTURE ================= */
-
-    if (!u->wasEnPassant && u->capturedPieceCode != 0) {
-        removePieceAt(b, toSq);
+    if (u->capturedPieceCode != 0) {
+        U64 capBit = bit(u->capturedSquare);
+        *pieceBoard(b, u->capturedPieceCode & 7, them) &= ~capBit;
+        *occupancyOf(b, them) &= ~capBit;
     }
 
     /* ================= MOVE PIECE ================= */
 
-    removePieceAt(b, fromSq);
-
-    if (mv.promotionPiece != 0) {
-        placePieceAt(b, toSq, mv.promotionPiece | moverColor);
-    } else {
-        placePieceAt(b, toSq, movingCode);
-    }
+    *pieceBoard(b, type, us) &= ~fromBit;
+    *pieceBoard(b, mv.promotionPiece ? mv.promotionPiece : type, us) |= toBit;
+    *occupancyOf(b, us) ^= fromBit | toBit;
 
     /* ================= CASTLING ROOK MOVE ================= */
 
-    if ((movingCode & 7) == KING &&
-        abs(fromFile - toFile) == 2) {
+    if (type == KING && (fromSq - toSq == 2 || toSq - fromSq == 2)) {
+        int homeRank = (us == WHITE) ? 0 : 56;
 
-        int kingRank = toRank;
-
-        if (toFile == 6) {              // king-side
-            u->rookFromSq = kingRank * 8 + 7;
-            u->rookToSq   = kingRank * 8 + 5;
+        if (toSq > fromSq) {            // king-side
+            u->rookFromSq = homeRank + 7;
+            u->rookToSq   = homeRank + 5;
         } else {                        // queen-side
-            u->rookFromSq = kingRank * 8 + 0;
-            u->rookToSq   = kingRank * 8 + 3;
+            u->rookFromSq = homeRank + 0;
+            u->rookToSq   = homeRank + 3;
         }
 
-        u->rookPieceCode = findPieceCodeAt(b, u->rookFromSq);
-
-        int rookCode = removePieceAt(b, u->rookFromSq);
-        if (rookCode)
-            placePieceAt(b, u->rookToSq, rookCode);
-
-        if (moverColor == WHITE) {
-            b->shortWhite = b->longWhite = false;
-        } else {
-            b->shortBlack = b->longBlack = false;
+        U64 rookMove = bit(u->rookFromSq) | bit(u->rookToSq);
+        if (rooksOf(b, us) & bit(u->rookFromSq)) {
+            u->rookPieceCode = ROOK | us;
+            *pieceBoard(b, ROOK, us) ^= rookMove;
+            *occupancyOf(b, us) ^= rookMove;
         }
     }
 
     /* ================= UPDATE CASTLING RIGHTS ================= */
 
-    if ((movingCode & 7) == KING) {
-        if (moverColor == WHITE) {
+    if (type == KING) {
+        if (us == WHITE) {
             b->shortWhite = b->longWhite = false;
         } else {
             b->shortBlack = b->longBlack = false;
         }
     }
 
-    if ((movingCode & 7) == ROOK) {
+    if (type == ROOK) {
         if (fromSq == 0)  b->longWhite  = false;
         if (fromSq == 7)  b->shortWhite = false;
         if (fromSq == 56) b->longBlack  = false;
@@ -666,168 +681,286 @@ bool applyMove(Board* b, Move mv, Undo* u) {
 
     /* ================= EN PASSANT SQUARE ================= */
 
-    if ((movingCode & 7) == PAWN && abs(toRank - fromRank) == 2) {
-        b->enPassantSquare = (fromRank + toRank) / 2 * 8 + fromFile;
+    if (type == PAWN && (fromSq ^ toSq) == 16) {
+        b->enPassantSquare = (fromSq + toSq) / 2;
     } else {
         b->enPassantSquare = -1;
     }
 
+    /* ================= HALFMOVE CLOCK / KEY ================= */
+
+    if (type == PAWN || u->capturedPieceCode != 0) {
+        b->halfmoveClock = 0;
+    } else {
+        b->halfmoveClock++;
+    }
+
+    U64 key = b->key ^ zobristSide;
+    key ^= zobristPiece[movingCode][fromSq];
+    key ^= zobristPiece[mv.promotionPiece ? (mv.promotionPiece | us) : movingCode][toSq];
+    if (u->capturedPieceCode != 0) {
+        key ^= zobristPiece[u->capturedPieceCode][u->capturedSquare];
+    }
+    if (u->rookPieceCode != 0) {
+        key ^= zobristPiece[u->rookPieceCode][u->rookFromSq];
+        key ^= zobristPiece[u->rookPieceCode][u->rookToSq];
+    }
+    key ^= zobristCastle[castleRights(u->prevShortWhite, u->prevLongWhite, u->prevShortBlack, u->prevLongBlack)];
+    key ^= zobristCastle[castleRights(b->shortWhite, b->longWhite, b->shortBlack, b->longBlack)];
+    key ^= prevEnPassantKey;
+    key ^= enPassantKey(b, them);
+    b->key = key;
+
     /* ================= FINALIZE ================= */
 
-    updateOccupancies(b);
-    b->mover = (b->mover == WHITE) ? BLACK : WHITE;
+    b->occupied = b->whitePieces | b->blackPieces;
+    b->mover = them;
     return true;
 }
-void unmakeMove(Board* b, Undo* u) {
-    b->mover = u->prevMover;
-
-    int fromSq = u->from;
-    int toSq   = u->to;
-
-    clearSquare(b, fromSq);
-    clearSquare(b, toSq);
+SPECIALIZED void unmakeMoveAs(Board* b, Undo* u, int us) {
+    const int them = us ^ COLOR_MASK;
+    U64 fromBit = bit(u->from);
+    U64 toBit   = bit(u->to);
 
-    placePieceAt(b, fromSq, u->movedPieceCode);
+    b->mover = us;
+    b->shortBlack = u->prevShortBlack; b->longBlack = u->prevLongBlack;
+    b->shortWhite = u->prevShortWhite; b->longWhite = u->prevLongWhite;
+    b->enPassantSquare = u->prevEnPassant;
+    b->halfmoveClock = u->prevHalfmoveClock;
+    b->key = u->prevKey;
 
-    if (u->capturedPieceCode != 0 && u->capturedSquare != -1) {
-        placePieceAt(b, u->capturedSquare, u->capturedPieceCode);
+    if (u->movedPieceCode == 0) {
+        return;                         // applyMove() refused the move
     }
 
-    if (u->rookFromSq != -1) {
-        clearSquare(b, u->rookToSq);
-        placePieceAt(b, u->rookFromSq, u->rookPieceCode);
+    // the piece on the target may be a promoted one, so clear every own board
+    *pieceBoard(b, PAWN, us)   &= ~toBit;
+    *pieceBoard(b, KNIGHT, us) &= ~toBit;
+    *pieceBoard(b, BISHOP, us) &= ~toBit;
+    *pieceBoard(b, ROOK, us)   &= ~toBit;
+    *pieceBoard(b, QUEEN, us)  &= ~toBit;
+    *pieceBoard(b, KING, us)   &= ~toBit;
+    *pieceBoard(b, u->movedPieceCode & 7, us) |= fromBit;
+    *occupancyOf(b, us) ^= fromBit | toBit;
+
+    if (u->rookPieceCode != 0) {
+        U64 rookMove = bit(u->rookFromSq) | bit(u->rookToSq);
+        *pieceBoard(b, ROOK, us) ^= rookMove;
+        *occupancyOf(b, us) ^= rookMove;
     }
 
-    b->shortBlack = u->prevShortBlack; b->longBlack = u->prevLongBlack;
-    b->shortWhite = u->prevShortWhite; b->longWhite = u->prevLongWhite;
-    b->enPassantSquare = u->prevEnPassant;
+    if (u->capturedPieceCode != 0) {
+        U64 capBit = bit(u->capturedSquare);
+        *pieceBoard(b, u->capturedPieceCode & 7, them) |= capBit;
+        *occupancyOf(b, them) |= capBit;
+    }
 
-    updateOccupancies(b);
+    b->occupied = b->whitePieces | b->blackPieces;
+}
+bool applyMove(Board* b, Move mv, Undo* u) {
+    return b->mover == WHITE ? applyMoveAs(b, mv, u, WHITE) : applyMoveAs(b, mv, u, BLACK);
+}
+void unmakeMove(Board* b, Undo* u) {
+    if (u->prevMover == WHITE) {
+        unmakeMoveAs(b, u, WHITE);
+    } else {
+        unmakeMoveAs(b, u, BLACK);
+    }
 }
 
 // ----------------- Move Generation Helpers -----------------
 
-static inline void addMoveToArray(Move *moves, int *count, int maxMoves, Move m) {
+SPECIALIZED void pushMove(Move* moves, int* count, int maxMoves, int from, int to, int promo) {
     if (*count < maxMoves) {
-        m.score = 0;
+        Move m = { from, to, promo, 0 };
         moves[(*count)++] = m;
     }
 }
-void generateMoves(Board* b, MoveList* moveList) {
-    updateOccupancies(b);
-
-    U64 pawns, knights, bishops, rooks, queens, kings;
-
-    if (b->mover == WHITE) {
-        pawns   = b->wp;
-        knights= b->wn;
-        bishops= b->wb;
-        rooks  = b->wr;
-        queens = b->wq;
-        kings  = b->wk;
-    } else {
-        pawns   = b->bp;
-        knights= b->bn;
-        bishops= b->bb;
-        rooks  = b->br;
-        queens = b->bq;
-        kings  = b->bk;
+// Targets of one ray in order of distance from the piece.
+SPECIALIZED void pushRay(Move* moves, int* count, int maxMoves, int from, U64 targets, bool positive) {
+    while (targets) {
+        int to = positive ? __builtin_ctzll(targets) : 63 - __builtin_clzll(targets);
+        targets &= ~bit(to);
+        pushMove(moves, count, maxMoves, from, to, 0);
     }
+}
+SPECIALIZED void pushDiagonals(Move* moves, int* count, int maxMoves, int sq, U64 occ, U64 notOwn) {
+    pushRay(moves, count, maxMoves, sq, negativeRay(DIR_SW, sq, occ) & notOwn, false);
+    pushRay(moves, count, maxMoves, sq, negativeRay(DIR_SE, sq, occ) & notOwn, false);
+    pushRay(moves, count, maxMoves, sq, positiveRay(DIR_NW, sq, occ) & notOwn, true);
+    pushRay(moves, count, maxMoves, sq, positiveRay(DIR_NE, sq, occ) & notOwn, true);
+}
+SPECIALIZED void pushOrthogonals(Move* moves, int* count, int maxMoves, int sq, U64 occ, U64 notOwn) {
+    pushRay(moves, count, maxMoves, sq, negativeRay(DIR_S, sq, occ) & notOwn, false);
+    pushRay(moves, count, maxMoves, sq, negativeRay(DIR_W, sq, occ) & notOwn, false);
+    pushRay(moves, count, maxMoves, sq, positiveRay(DIR_E, sq, occ) & notOwn, true);
+    pushRay(moves, count, maxMoves, sq, positiveRay(DIR_N, sq, occ) & notOwn, true);
+}
+/*
+ * Pseudo-legal moves straight into an array: pieces by type, then square;
+ * sliders ray by ray. Move ordering ties are broken by this order, so
+ * changing it changes search results.
+ */
+SPECIALIZED int pseudoMovesAs(const Board* b, const AttackInfo* ai, Move* moves, int maxMoves, int us) {
+    const int them = us ^ COLOR_MASK;
+    const int up = (us == WHITE) ? 8 : -8;
+    const U64 occ = b->occupied;
+    const U64 notOwn = ~piecesOf(b, us);
+    const U64 enemy = piecesOf(b, them);
+    const U64 startRank = (us == WHITE) ? 0x000000000000ff00ULL : 0x00ff000000000000ULL;
+    const U64 lastRank  = (us == WHITE) ? 0xff00000000000000ULL : 0x00000000000000ffULL;
+    int count = 0;
+    U64 pieces;
+
+    pieces = pawnsOf(b, us);
+    while (pieces) {
+        int sq = pop_lsb(&pieces);
+        int f = fileOf(sq);
+        int to = sq + up;
 
-
-    // pawns
-    U64 tmp = pawns;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        pawnMoves(b, moveList, sq);
+        if (!(occ & bit(to))) {
+            if (bit(to) & lastRank) {
+                for (int p = KNIGHT; p <= QUEEN; ++p) pushMove(moves, &count, maxMoves, sq, to, p);
+            } else {
+                pushMove(moves, &count, maxMoves, sq, to, 0);
+                if ((bit(sq) & startRank) && !(occ & bit(to + up))) {
+                    pushMove(moves, &count, maxMoves, sq, to + up, 0);
+                }
+            }
+        }
+        for (int df = -1; df <= 1; df += 2) {
+            if (f + df < 0 || f + df > 7) continue;
+            int t = to + df;
+            if (enemy & bit(t)) {
+                if (bit(t) & lastRank) {
+                    for (int p = KNIGHT; p <= QUEEN; ++p) pushMove(moves, &count, maxMoves, sq, t, p);
+                } else {
+                    pushMove(moves, &count, maxMoves, sq, t, 0);
+                }
+            } else if (t == b->enPassantSquare && !(occ & bit(t)) && (pawnsOf(b, them) & bit(t - up))) {
+                pushMove(moves, &count, maxMoves, sq, t, 0);
+            }
+        }
     }
 
-    // knights
-    tmp = knights;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        knightMoves(b, moveList, sq);
+    pieces = knightsOf(b, us);
+    while (pieces) {
+        int sq = pop_lsb(&pieces);
+        pushRay(moves, &count, maxMoves, sq, knightAttacks[sq] & notOwn, true);
     }
-
-    // bishops
-    tmp = bishops;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        bishopMoves(b, moveList, sq);
+    pieces = bishopsOf(b, us);
+    while (pieces) {
+        int sq = pop_lsb(&pieces);
+        pushDiagonals(moves, &count, maxMoves, sq, occ, notOwn);
     }
-
-    // rooks
-    tmp = rooks;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        rookMoves(b, moveList, sq);
+    pieces = rooksOf(b, us);
+    while (pieces) {
+        int sq = pop_lsb(&pieces);
+        pushOrthogonals(moves, &count, maxMoves, sq, occ, notOwn);
     }
-
-    // queens
-    tmp = queens;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        queenMoves(b, moveList, sq);
+    pieces = queensOf(b, us);
+    while (pieces) {
+        int sq = pop_lsb(&pieces);
+        pushDiagonals(moves, &count, maxMoves, sq, occ, notOwn);
+        pushOrthogonals(moves, &count, maxMoves, sq, occ, notOwn);
     }
 
-    // kings
-    tmp = kings;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        kingMoves(b, moveList, sq);
+    pieces = kingOf(b, us);
+    while (pieces) {
+        int sq = pop_lsb(&pieces);
+        pushRay(moves, &count, maxMoves, sq, kingAttacks[sq] & notOwn, true);
+
+        // king square and the squares it crosses must not be attacked
+        const int home = (us == WHITE) ? 0 : 56;
+        const bool canShort = (us == WHITE) ? b->shortWhite : b->shortBlack;
+        const bool canLong  = (us == WHITE) ? b->longWhite : b->longBlack;
+        U64 enemyAttacks = ai->attacked[colorIndex(them)];
+        if (sq == home + 4) {
+            if (canShort && !(occ & (0x60ULL << home)) && !(enemyAttacks & (0x70ULL << home))) {
+                pushMove(moves, &count, maxMoves, sq, home + 6, 0);
+            }
+            if (canLong && !(occ & (0x0EULL << home)) && !(enemyAttacks & (0x1CULL << home))) {
+                pushMove(moves, &count, maxMoves, sq, home + 2, 0);
+            }
+        }
     }
-
-    // assert(moveList->count < moveList->size);
-
+    return count;
+}
+static void pseudoMovesToArray(Board* b, const AttackInfo* ai, Move* moves, uint64_t* outCount, int maxMoves) {
+    *outCount = b->mover == WHITE ? pseudoMovesAs(b, ai, moves, maxMoves, WHITE)
+                                  : pseudoMovesAs(b, ai, moves, maxMoves, BLACK);
 }
 void generateMovesToArray(Board* b, Move* moves, uint64_t* outCount, int maxMoves) {
-    MoveList m = {0};
-    initMoveList(&m, 512);
-    generateMoves(b, &m);
-
-    int c = 0;
-    for (size_t i = 0; i < m.count && c < maxMoves; ++i) {
-        addMoveToArray(moves, &c, maxMoves, m.moves[i]);
-    }
-    *outCount = c;
+    updateOccupancies(b);
 
-    if (m.moves) {
-        free(m.moves);
-    }
+    AttackInfo ai;
+    computeAttackInfo(b, &ai);
+    pseudoMovesToArray(b, &ai, moves, outCount, maxMoves);
 }
 void generateLegalMovesToArray(Board *board, Move *outMoves, uint64_t *outCount, size_t maxMoves) {
+    AttackInfo ai;
+    computeAttackInfo(board, &ai);
+    generateLegalMovesWithAttacks(board, &ai, outMoves, outCount, maxMoves);
+}
+/*
+ * Legality is decided from the attack info wherever possible: king moves
+ * must land outside the enemy attack map (and off the line of a checking
+ * slider), other moves must resolve any check and keep pinned pieces on
+ * their pin line. Only en passant, which can expose the king along the
+ * rank, still goes through make / isAttacked / unmake.
+ */
+void generateLegalMovesWithAttacks(Board *board, const AttackInfo *ai, Move *outMoves, uint64_t *outCount, size_t maxMoves) {
+    uint64_t idx = 0;
+    int us = colorIndex(board->mover);
+    int ksq = ai->kingSq[us];
+    if (ksq < 0) {
+        *outCount = 0;
+        return;
+    }
+
     Move temp[512];
     uint64_t tc = 0;
-    generateMovesToArray(board, temp, &tc, 512);
-
-    uint64_t idx = 0;
-    for (uint64_t i = 0; i < tc; ++i) {
-        Undo u;
-        if (!applyMove(board, temp[i], &u)) {
-            continue;
+    pseudoMovesToArray(board, ai, temp, &tc, 512);
+
+    U64 kingForbidden = ai->attacked[us ^ 1];
+    U64 evasionTargets = ~0ULL;
+    if (ai->checkers) {
+        U64 checkers = ai->checkers;
+        if (checkers & (checkers - 1)) {
+            evasionTargets = 0ULL;      // double check: only the king may move
+        } else {
+            evasionTargets = checkers | betweenMask[ksq][__builtin_ctzll(checkers)];
         }
-
-        int moverColor = u.prevMover;
-
-        int kingPos = -1;
-        U64 kings = (moverColor == WHITE) ? board->wk : board->bk;
-        if (kings) {
-            kingPos = __builtin_ctzll(kings);
+        U64 theirSliders = (board->mover == WHITE)
+            ? (board->bb | board->br | board->bq)
+            : (board->wb | board->wr | board->wq);
+        U64 sliders = checkers & theirSliders;
+        while (sliders) {
+            int s = pop_lsb(&sliders);
+            kingForbidden |= lineMask[ksq][s] & ~bit(s);
         }
+    }
+    U64 ownPawns = (board->mover == WHITE) ? board->wp : board->bp;
 
-        bool legal = true;
-        if (kingPos == -1) {
-            legal = false;
+    for (uint64_t i = 0; i < tc; ++i) {
+        const Move m = temp[i];
+        bool legal;
+
+        if (m.from == ksq) {
+            legal = !(kingForbidden & bit(m.to));
+        } else if (m.to == board->enPassantSquare && (ownPawns & bit(m.from))) {
+            Undo u;
+            applyMove(board, m, &u);
+            legal = !isAttacked(board, ksq, u.prevMover);
+            unmakeMove(board, &u);
         } else {
-            int kr = rankOf(kingPos), kf = fileOf(kingPos);
-            if (isAttacked(*board, kr, kf, moverColor)) legal = false;
+            legal = (evasionTargets & bit(m.to)) &&
+                    (!(ai->pinned & bit(m.from)) || (lineMask[ksq][m.from] & bit(m.to)));
         }
 
-        unmakeMove(board, &u);
         if (legal && idx < maxMoves) {
-            outMoves[idx++] = temp[i];
+            outMoves[idx++] = m;
         }
-
     }
     *outCount = idx;
 }
@@ -886,6 +1019,78 @@ void printMove(const Move m) {
     if (m.promotionPiece != 0) printf("%c", promotionChar(m.promotionPiece));
     printf("\n");
 }
+// UCI long algebraic notation, promotion piece in lower case
+void moveToString(const Move m, char out[6]) {
+    out[0] = fileChar(m.from % 8);
+    out[1] = rankChar(m.from / 8);
+    out[2] = fileChar(m.to % 8);
+    out[3] = rankChar(m.to / 8);
+    out[4] = m.promotionPiece ? (char)tolower((unsigned char)promotionChar(m.promotionPiece)) : '\0';
+    out[5] = '\0';
+}
+// Standard algebraic notation (Nbd7, exd6, e8=Q, O-O) with a + or # suffix.
+void moveToSAN(Board* b, Move m, char out[SAN_MAX]) {
+    int piece = pieceAt(b, m.from) & 7;
+    char* p = out;
+
+    if (piece == KING && (m.to - m.from == 2 || m.from - m.to == 2)) {
+        strcpy(p, m.to > m.from ? "O-O" : "O-O-O");
+        p += strlen(p);
+    } else {
+        bool capture = (b->occupied & bit(m.to))
+                       || (piece == PAWN && m.to == b->enPassantSquare);
+
+        if (piece == PAWN) {
+            if (capture) *p++ = fileChar(fileOf(m.from));
+        } else {
+            *p++ = pieceChar(piece | WHITE);
+
+            // disambiguate against other pieces of this type reaching m.to
+            Move legal[256];
+            uint64_t count = 0;
+            bool ambiguous = false, sameFile = false, sameRank = false;
+            generateLegalMovesToArray(b, legal, &count, 256);
+            for (uint64_t i = 0; i < count; i++) {
+                if (legal[i].to != m.to || legal[i].from == m.from
+                    || (pieceAt(b, legal[i].from) & 7) != piece)
+                    continue;
+                ambiguous = true;
+                if (fileOf(legal[i].from) == fileOf(m.from)) sameFile = true;
+                if (rankOf(legal[i].from) == rankOf(m.from)) sameRank = true;
+            }
+            if (ambiguous) {
+                if (!sameFile) {
+                    *p++ = fileChar(fileOf(m.from));
+                } else if (!sameRank) {
+                    *p++ = rankChar(rankOf(m.from));
+                } else {
+                    *p++ = fileChar(fileOf(m.from));
+                    *p++ = rankChar(rankOf(m.from));
+                }
+            }
+        }
+        if (capture) *p++ = 'x';
+        *p++ = fileChar(fileOf(m.to));
+        *p++ = rankChar(rankOf(m.to));
+        if (m.promotionPiece) {
+            *p++ = '=';
+            *p++ = promotionChar(m.promotionPiece);
+        }
+    }
+
+    Undo u;
+    AttackInfo ai;
+    applyMove(b, m, &u);
+    computeAttackInfo(b, &ai);
+    if (ai.checkers) {
+        Move replies[256];
+        uint64_t count = 0;
+        generateLegalMovesWithAttacks(b, &ai, replies, &count, 256);
+        *p++ = count ? '+' : '#';
+    }
+    unmakeMove(b, &u);
+    *p = '\0';
+}
 void printMoves(const MoveList* mL) {
     for (size_t i = 0; i < mL->count; i++) printMove(mL->moves[i]);
 }
@@ -920,7 +1125,122 @@ void boardSetup(Board* b) {
     b->shortBlack  = true; b->shortWhite = true; b->longBlack  = true; b->longWhite = true;
     b->enPassantSquare = -1;
     b->mover = WHITE;
+    b->halfmoveClock = 0;
+    updateOccupancies(b);
+    b->key = computeKey(b);
+}
+// Parses the board, side, castling, en passant and halfmove fields of a FEN
+// string. Returns false (leaving the board empty) on malformed placement or
+// when the side that just moved is in check, which no legal game reaches.
+bool parseFEN(Board* b, const char* fen) {
+    memset(b, 0, sizeof(Board));
+    b->enPassantSquare = -1;
+
+    const char* p = fen;
+    while (*p == ' ') p++;
+
+    int r = 7, f = 0;
+    for (; *p && *p != ' '; ++p) {
+        char c = *p;
+        if (c == '/') {
+            r--; f = 0;
+            continue;
+        }
+        if (c >= '1' && c <= '8') {
+            f += c - '0';
+            continue;
+        }
+
+        int piece = 0;
+        switch (tolower((unsigned char)c)) {
+            case 'p': piece = PAWN;   break;
+            case 'n': piece = KNIGHT; break;
+            case 'b': piece = BISHOP; break;
+            case 'r': piece = ROOK;   break;
+            case 'q': piece = QUEEN;  break;
+            case 'k': piece = KING;   break;
+            default:  return false;
+        }
+        if (r < 0 || f > 7) return false;
+        setPiece(b, sq_index(r, f), piece | (isupper((unsigned char)c) ? WHITE : BLACK));
+        f++;
+    }
+
+    while (*p == ' ') p++;
+    b->mover = (*p == 'b') ? BLACK : WHITE;
+    if (*p) p++;
+
+    while (*p == ' ') p++;
+    for (; *p && *p != ' '; ++p) {
+        switch (*p) {
+            case 'K': b->shortWhite = true; break;
+            case 'Q': b->longWhite  = true; break;
+            case 'k': b->shortBlack = true; break;
+            case 'q': b->longBlack  = true; break;
+            default: break;
+        }
+    }
+
+    while (*p == ' ') p++;
+    if (p[0] >= 'a' && p[0] <= 'h' && p[1] >= '1' && p[1] <= '8') {
+        b->enPassantSquare = sq_index(p[1] - '1', p[0] - 'a');
+        p += 2;
+    } else if (*p == '-') {
+        p++;
+    }
+
+    while (*p == ' ') p++;
+    if (*p >= '0' && *p <= '9') {
+        b->halfmoveClock = (int)strtol(p, NULL, 10);
+    }
+
     updateOccupancies(b);
+    U64 theirKing = kingOf(b, b->mover ^ COLOR_MASK);
+    if (theirKing && squareAttackedBy(b, __builtin_ctzll(theirKing), b->mover)) {
+        memset(b, 0, sizeof(Board));
+        b->enPassantSquare = -1;
+        return false;
+    }
+    b->key = computeKey(b);
+    return true;
+}
+
+// Board has no fullmove counter, so the FEN always ends in "1".
+void boardToFEN(const Board* b, char out[FEN_MAX]) {
+    char* p = out;
+    for (int r = 7; r >= 0; r--) {
+        int empty = 0;
+        for (int f = 0; f < 8; f++) {
+            int code = pieceAt(b, sq_index(r, f));
+            if (!code) {
+                empty++;
+                continue;
+            }
+            if (empty) *p++ = (char)('0' + empty);
+            empty = 0;
+            *p++ = pieceChar(code);
+        }
+        if (empty) *p++ = (char)('0' + empty);
+        if (r) *p++ = '/';
+    }
+
+    *p++ = ' ';
+    *p++ = b->mover == WHITE ? 'w' : 'b';
+    *p++ = ' ';
+    if (b->shortWhite) *p++ = 'K';
+    if (b->longWhite)  *p++ = 'Q';
+    if (b->shortBlack) *p++ = 'k';
+    if (b->longBlack)  *p++ = 'q';
+    if (p[-1] == ' ') *p++ = '-';
+
+    *p++ = ' ';
+    if (b->enPassantSquare >= 0) {
+        *p++ = fileChar(fileOf(b->enPassantSquare));
+        *p++ = rankChar(rankOf(b->enPassantSquare));
+    } else {
+        *p++ = '-';
+    }
+    snprintf(p, (size_t)(FEN_MAX - (p - out)), " %d 1", b->halfmoveClock);
 }
 
 // ----------------- Perft / counting -----------------
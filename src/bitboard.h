@@ -15,21 +15,41 @@
 #define MAX_PHASE (PAWN_PHASE*16 + KNIGHT_PHASE*4 + BISHOP_PHASE*4 + ROOK_PHASE*4 + QUEEN_PHASE*2)
 // = 24
 
-#define DOUBLED_PAWN_BONUS (-10)
-#define ISOLATED_PAWN_BONUS_MG (-10)
-#define ISOLATED_PAWN_BONUS_EG (-20)
-#define PASSED_PAWN_BONUS_MG 10
-#define PASSED_PAWN_BONUS_EG 30
+// quiescence() trusts material + PST alone when it is this far outside the window
+#define LAZY_EVAL_MARGIN 250
+
 
 #define MAX_DEPTH 64
 #define KILLERS_PER_DEPTH 2
 #define SCORE_PROMO     9000000
 #define SCORE_CAPTURE   8000000
 #define SCORE_KILLER    7000000
+#define SCORE_COUNTER   6000000
 #define SCORE_HISTORY   0
 
 
-#define HISTORY_MAX 64
+#define HISTORY_MAX 16384
+#define HISTORY_BONUS_MAX 1600
+
+#define MAX_GAME_PLY 4096
+#define FEN_MAX 96      // longest FEN this engine writes, plus terminator
+#define SAN_MAX 10      // longest SAN ("Qa1xb2+", "exd8=Q#") plus terminator
+
+#define INF_SCORE  10000000
+#define MATE_SCORE 100000
+#define MATE_BOUND (MATE_SCORE - MAX_DEPTH)     // scores beyond this are mates
+#define TB_WIN_SCORE (MATE_BOUND - 1)           // tablebase wins, just below any mate
+#define TB_WIN_BOUND (TB_WIN_SCORE - MAX_DEPTH)
+
+#define SCORE_TT_MOVE   10000000
+
+#define TT_BUCKET_SIZE 4
+#define TT_DEFAULT_MB 16
+#define DETERMINISTIC_NODES_PER_MS 1000     // clock-to-node conversion in deterministic mode
+
+#ifndef EVAL_CACHE_BITS
+#define EVAL_CACHE_BITS 16      // 2^16 entries of 8 bytes per search thread
+#endif
 
 // #define ASSERT_SQ(sq) assert((sq) >= 0 && (sq) < 64)
 
@@ -63,6 +83,9 @@ typedef struct {
         int enPassantSquare;
 
         int mover;
+
+        int halfmoveClock;      // plies since the last capture or pawn move
+        U64 key;                // Zobrist key, updated incrementally by applyMove()
     } Board;
 typedef struct {
     int from;
@@ -84,6 +107,8 @@ typedef struct {
     bool prevShortBlack, prevLongBlack, prevShortWhite, prevLongWhite;
     int prevEnPassant;
     int prevMover;
+    int prevHalfmoveClock;
+    U64 prevKey;
 
     int rookFromSq;
     int rookToSq;
@@ -92,24 +117,214 @@ typedef struct {
     bool wasEnPassant;
 } Undo;
 
+/*
+ * Attack information for one position, computed once per node by
+ * computeAttackInfo() and shared by move generation and evaluation.
+ * Side-indexed arrays use colorIndex(): 0 = white, 1 = black.
+ * checkers / pinned are relative to the side to move.
+ */
+typedef struct {
+    U64 attacked[2];            // every square attacked by a side
+    U64 attackedBy[2][7];       // squares attacked by a piece type (PAWN..KING)
+    int mobility[2][7];         // attacked squares not occupied by own pieces
+    U64 checkers;               // enemy pieces giving check
+    U64 pinned;                 // own pieces pinned against the king
+    int kingSq[2];              // -1 if the side has no king
+} AttackInfo;
+
+/* transposition table: 16-byte slots, four per 64-byte bucket */
+enum { TT_NONE = 0, TT_EXACT = 1, TT_LOWER = 2, TT_UPPER = 3 };
+typedef struct {
+    U64 key;
+    int32_t score;
+    uint16_t move;              // packMove() encoding, 0 = none
+    int8_t depth;
+    uint8_t boundAge;           // bound in the low 2 bits, search generation above
+} TTEntry;
+/*
+ * A stored entry: the TTEntry fields packed into one word, and the key xored
+ * with that word. Both are read and written as separate relaxed atomics, so
+ * a slot torn by threads writing it at once fails the key check on probe
+ * instead of pairing one position's key with another's move and score.
+ */
+typedef struct {
+    U64 keyXorData;
+    U64 data;                   // score | move << 32 | depth << 48 | boundAge << 56
+} TTSlot;
+typedef struct {
+    TTSlot slots[TT_BUCKET_SIZE];
+} TTBucket;
+
+/* one "info" report: a finished iteration of one MultiPV line */
+typedef struct {
+    int depth;
+    int selDepth;
+    int multiPV;                // 1-based line number
+    int score;                  // side to move; mates are within MATE_BOUND of MATE_SCORE
+    uint64_t nodes;
+    uint64_t nps;
+    int64_t timeMs;             // -1 for deterministic searches, which never read the clock
+    int hashfull;
+    uint64_t tbHits;
+    const Move* pv;
+    int pvLength;
+} SearchInfo;
+typedef void (*SearchInfoFn)(const SearchInfo* info, void* data);
+
+/* search limits for findBestMove(); 0 means "not set" */
+typedef struct {
+    int depth;
+    int64_t moveTimeMs;         // fixed time for this move
+    int64_t timeLeftMs;         // clock of the side to move
+    int64_t incrementMs;
+    int movesToGo;
+    uint64_t nodes;             // node budget, checked like the hard deadline
+    int multiPV;                // number of best lines to report (MultiPV)
+    bool silent;                // no "info" output
+    bool deterministic;         // fixed start state, clocks become node budgets
+    bool ponder;                // "go ponder": the clock limits start at *ponderhit
+    bool infinite;              // "go infinite": no bestmove before *stop
+    const bool* stop;           // polled with the clock; set from another thread to abort
+    const bool* ponderhit;      // set from another thread when the ponder move is played
+    SearchInfoFn onInfo;        // receives the info reports instead of stdout
+    void* infoData;
+} SearchLimits;
+
+/* outcome of findBestMove(), from the side to move */
+typedef struct {
+    int score;
+    int depth;                  // last completed iteration, 0 for book moves
+    int selDepth;
+    uint64_t nodes;
+    int64_t timeMs;             // 0 for deterministic searches
+    Move ponder;                // expected reply from the PV, from == -1 if none
+} SearchResult;
+
+/*
+ * Search statistics, compiled in with -DSEARCH_STATS (make STATS=1) and
+ * free otherwise. One block per thread, padded to whole cache lines; it is
+ * reset by findBestMove() and printed after the search and by "stats".
+ * Cycle counts are TSC ticks on x86-64, nanoseconds elsewhere.
+ */
+typedef struct {
+    uint64_t nodes;             // minimax() calls
+    uint64_t qnodes;            // quiescence() calls
+    uint64_t expanded;          // minimax() nodes that reached the move loop
+    uint64_t failHighs;
+    uint64_t failHighFirst;     // ... on the first move searched
+    uint64_t ttProbes;
+    uint64_t ttHits;
+    uint64_t ttCutoffs;
+    uint64_t movesGenerated;    // legal moves in expanded nodes
+    uint64_t movesSearched;
+    uint64_t qMovesGenerated;
+    uint64_t qCapturesSearched;
+    uint64_t standPatCutoffs;
+    uint64_t lazyCutoffs;       // stand-pat cutoffs decided by material + PST
+    uint64_t evals;             // full evaluations
+    uint64_t iterationNodes[2]; // nodes of the last two completed iterations
+    uint64_t cyclesSearch;
+    uint64_t cyclesEval;
+    uint64_t cyclesMovegen;     // legal move generation, attack maps included
+    uint64_t cyclesOrdering;
+    uint64_t cyclesTT;
+} __attribute__((aligned(64))) SearchStats;
+
+#ifdef SEARCH_STATS
+extern _Thread_local SearchStats searchStats;
+uint64_t statsClock(void);
+#define STAT_INC(field)       (searchStats.field++)
+#define STAT_ADD(field, n)    (searchStats.field += (n))
+#define STAT_TIME(field, ...) do { uint64_t t0_ = statsClock(); __VA_ARGS__; \
+                                   searchStats.field += statsClock() - t0_; } while (0)
+#else
+#define STAT_INC(field)       ((void)0)
+#define STAT_ADD(field, n)    ((void)0)
+#define STAT_TIME(field, ...) do { __VA_ARGS__; } while (0)
+#endif
+
 /* attack tables */
 extern U64 knightAttacks[64];
 extern U64 kingAttacks[64];
 extern U64 bishopAttacks[64];
+extern U64 pawnAttacks[2][64];
+extern U64 betweenMask[64][64];
+extern U64 lineMask[64][64];
+
+/*
+ * Evaluation parameters. evalParams starts as defaultEvalParams and can be
+ * replaced at runtime (EvalFile); evalPrepare() must run after any change
+ * to rebuild the tables read by evaluate().
+ */
+enum { MG = 0, EG = 1 };
+typedef struct {
+    int material[7];            // by piece type, both phases
+    int pst[7][2][64];          // [piece type][MG/EG][square], white's side, a1 = 0
+    int doubledPawn;            // per extra pawn on a file, both phases
+    int isolatedPawn[2];
+    int passedPawn[2];
+    int mobility[7][2];         // per attacked square not holding an own piece
+    int hangingPiece[2];        // attacked and undefended non-pawn piece
+    int kingZoneAttack;         // middlegame, per attacked square around the king
+    int kingBackRank;           // king on its first two ranks
+    int kingExposed;            // king anywhere else
+    int kingShieldPawn;         // own pawn on the three squares in front of the king
+} EvalParams;
+
+#define EVAL_PARAM_COUNT ((int)(sizeof(EvalParams) / sizeof(int)))
+
+extern const EvalParams defaultEvalParams;
+extern EvalParams evalParams;
+
+/*
+ * Middlegame and endgame values packed into one integer, eg in the high
+ * half, so that adding or scaling a Score works on both at once. Each half
+ * must stay within int16 for the final sum.
+ */
+typedef int32_t Score;
+static inline Score makeScore(int mg, int eg) {
+    return (Score)((uint32_t)eg << 16) + mg;
+}
+static inline int mgValue(Score s) {
+    return (int16_t)(uint16_t)(uint32_t)s;
+}
+static inline int egValue(Score s) {
+    return (int16_t)(uint16_t)((uint32_t)(s + 0x8000) >> 16);
+}
 
-/* piece-square tables */
-extern int PST_PAWN[8][8];
-extern int PST_PAWN_END[8][8];
-extern int PST_KNIGHT[8][8];
-extern int PST_KNIGHT_END[8][8];
-extern int PST_BISHOP[8][8];
-extern int PST_BISHOP_END[8][8];
-extern int PST_ROOK[8][8];
-extern int PST_ROOK_END[8][8];
-extern int PST_QUEEN[8][8];
-extern int PST_QUEEN_END[8][8];
-extern int PST_KING_MID[8][8];
-extern int PST_KING_END[8][8];
+/* EvalParams packed by evalPrepare(); tables mirrored and negated for black */
+typedef struct {
+    Score doubledPawn;
+    Score isolatedPawn;
+    Score passedPawn;
+    Score mobility[7];
+    Score hangingPiece;
+    Score kingZoneAttack;
+    Score kingBackRank;
+    Score kingExposed;
+    Score kingShieldPawn;
+} EvalTerms;
+
+extern EvalTerms evalTerms;
+extern Score pieceSquareScore[16][64];      // material + PST by piece code and square
+extern uint32_t evalGeneration;             // bumped by evalPrepare(), invalidates eval caches
+
+/* zobrist keys */
+extern U64 zobristPiece[16][64];
+extern U64 zobristCastle[16];
+extern U64 zobristEnPassant[8];
+extern U64 zobristSide;
+
+/*
+ * Keys of the positions that led to the current one: filled from the
+ * "position ... moves" replay and extended by the search around every
+ * applyMove(). keyHistory[keyHistoryCount - 1] is one ply ago.
+ * Per thread, like all search state. A game replay stops at MAX_GAME_PLY,
+ * the search adds at most one key per ply on top.
+ */
+#define KEY_HISTORY_SIZE (MAX_GAME_PLY + MAX_DEPTH + 1)
+extern _Thread_local U64 keyHistory[KEY_HISTORY_SIZE];
+extern _Thread_local int keyHistoryCount;
 
 /*  MVV-LVA Table  */
 
@@ -120,6 +335,44 @@ static inline U64 bit(int sq) { return 1ULL << (sq); }
 static inline int rankOf(int sq) { return (sq) >> 3; }
 static inline int fileOf(int sq) { return (sq) & 7; }
 static inline int sq_index(int rank, int file) { return (rank) * 8 + (file); }
+static inline int colorIndex(int color) { return color >> 3; }
+
+/*
+ * Color-specialized kernels (move generation, make/unmake, move scoring):
+ * the helpers below and the ones built on them take the color as a
+ * parameter but are always inlined, and every caller passes WHITE or BLACK
+ * as a constant (usually from a single dispatch on b->mover), so each
+ * color gets its own branch-free copy of the inner loops.
+ */
+#define SPECIALIZED static inline __attribute__((always_inline))
+
+SPECIALIZED U64 pawnsOf(const Board* b, int color)   { return color == WHITE ? b->wp : b->bp; }
+SPECIALIZED U64 knightsOf(const Board* b, int color) { return color == WHITE ? b->wn : b->bn; }
+SPECIALIZED U64 bishopsOf(const Board* b, int color) { return color == WHITE ? b->wb : b->bb; }
+SPECIALIZED U64 rooksOf(const Board* b, int color)   { return color == WHITE ? b->wr : b->br; }
+SPECIALIZED U64 queensOf(const Board* b, int color)  { return color == WHITE ? b->wq : b->bq; }
+SPECIALIZED U64 kingOf(const Board* b, int color)    { return color == WHITE ? b->wk : b->bk; }
+SPECIALIZED U64 piecesOf(const Board* b, int color)  { return color == WHITE ? b->whitePieces : b->blackPieces; }
+
+// Piece code of color on the square mask m, 0 if none.
+SPECIALIZED int pieceOfColorAt(const Board* b, U64 m, int color) {
+    if (pawnsOf(b, color) & m)   return PAWN | color;
+    if (knightsOf(b, color) & m) return KNIGHT | color;
+    if (bishopsOf(b, color) & m) return BISHOP | color;
+    if (rooksOf(b, color) & m)   return ROOK | color;
+    if (queensOf(b, color) & m)  return QUEEN | color;
+    if (kingOf(b, color) & m)    return KING | color;
+    return 0;
+}
+
+/* compact move encoding used by the transposition table */
+static inline uint16_t packMove(Move m) {
+    return (uint16_t)(m.from | (m.to << 6) | (m.promotionPiece << 12));
+}
+static inline Move unpackMove(uint16_t p) {
+    Move m = { p & 63, (p >> 6) & 63, (p >> 12) & 7, 0 };
+    return m;
+}
 
 /* pop lsb */
 static inline int pop_lsb(U64 *b) {
@@ -131,9 +384,10 @@ static inline int pop_lsb(U64 *b) {
 
 /* initialization / attack table */
 void initAttackTables(void);
+void initZobrist(void);
 
 /* move list helpers */
-void initMoveList(MoveList* mL, int size);
+void initMoveList(MoveList* mL, size_t size);
 void addMove(MoveList* mL, Move move);
 
 /* board helpers */
@@ -145,28 +399,29 @@ int findPieceCodeAt(const Board* b, int sq);
 
 /* attack queries */
 U64 rayAttacksFrom(int sq, int dr, int df, U64 occupancy);
-bool isAttacked(Board board, int row, int col, int color);
-
-/* move generation */
-void addMoveToListFromTo(MoveList* mL, int fromSq, int toSq, int promo);
-void pawnMoves(Board* b, MoveList* mL, int sq);
-void knightMoves(Board* b, MoveList* mL, int sq);
-void slidingMoves(Board* b, MoveList* mL, int sq, const int directions[4][2], int dirCount);
-void bishopMoves(Board* b, MoveList* mL, int sq);
-void rookMoves(Board* b, MoveList* mL, int sq);
-void queenMoves(Board* b, MoveList* mL, int sq);
-void kingMoves(Board* b, MoveList* mL, int sq);
-void generateMoves(Board* b, MoveList* moveList);
+U64 bishopAttacksFrom(int sq, U64 occupancy);
+U64 rookAttacksFrom(int sq, U64 occupancy);
+bool isAttacked(const Board* b, int sq, int color);     // by the side opposing color
+void computeAttackInfo(const Board* b, AttackInfo* ai);
+
+/* zobrist / repetition */
+U64 computeKey(const Board* b);
+void resetKeyHistory(void);
+void pushKeyHistory(U64 key);
+void popKeyHistory(void);
+bool isRepetition(const Board* b);
+bool hasUpcomingRepetition(const Board* b, int ply);
 
 /* apply / make / unmake */
 int removePieceAt(Board* b, int sq);
 void placePieceAt(Board* b, int sq, int pieceCode);
-void applyMove(Board* b, Move mv, Undo* u);
+bool applyMove(Board* b, Move mv, Undo* u);
 void unmakeMove(Board* b, Undo* u);
 
 /* array-based move generation */
-void generateMovesToArray(Board* b, Move* moves, int* outCount, int maxMoves);
-void generateLegalMovesToArray(Board *board, Move *outMoves, uint64_t *outCount, int maxMoves);
+void generateMovesToArray(Board* b, Move* moves, uint64_t* outCount, int maxMoves);
+void generateLegalMovesToArray(Board *board, Move *outMoves, uint64_t *outCount, size_t maxMoves);
+void generateLegalMovesWithAttacks(Board *board, const AttackInfo *ai, Move *outMoves, uint64_t *outCount, size_t maxMoves);
 void generateLegalMoves (Board * board, MoveList* moves);
 
 /* helpers / printing */
@@ -176,8 +431,12 @@ char fileChar(int file);
 char rankChar(int rank);
 char promotionChar(int promotion);
 void printMove(Move m);
+void moveToString(Move m, char out[6]);
+void moveToSAN(Board* b, Move m, char out[SAN_MAX]);
 void printMoves(const MoveList* mL);
 void boardSetup(Board* b);
+bool parseFEN(Board* b, const char* fen);
+void boardToFEN(const Board* b, char out[FEN_MAX]);
 
 /* perft */
 uint64_t countMoves(Board* board, int depth);
@@ -185,9 +444,71 @@ void perft_divide(Board board, int depth);
 int perft_main(void);
 
 int evaluate(Board* board);
+int computePhase(const Board* board);
+int doubledPawns(const Board* board, const int color);
+int isolatedPawns(const Board* board, const int color);
+int passedPawns(const Board* board, const int color);
+int evaluateWithAttacks(Board* board, const AttackInfo* ai);
+int scoreMove(const Board* b, const Move* m, const int ply);     // move ordering score
+
+/* per-thread evaluation cache, see evaluation.c */
+typedef struct {
+    uint64_t probes;
+    uint64_t hits;
+    uint64_t stores;
+    size_t entries;
+    size_t used;                // non-empty slots
+} EvalCacheStats;
+void evalCacheClear(void);
+void evalCacheGetStats(EvalCacheStats* out);
+
+/* search statistics (stats.c) */
+void statsReset(void);
+void statsPrint(void);
+extern _Thread_local uint64_t nodesSearched;
+void clearHeuristics(void);
+void ageHeuristics(void);
+Move findBestMove(Board* board, const SearchLimits* limits, SearchResult* result);
+#define SEARCH_INFO_MAX (256 + 6 * (MAX_DEPTH + 1)) // formatted "info" line, PV included
+int formatSearchInfo(const SearchInfo* info, char* out, size_t size);
+void printSearchInfo(const SearchInfo* info);  // as a UCI "info" line
 int search(Board *b, int depth);
 int minimax(Board * board, int depth, int alpha, int beta, int ply);
 
+/* transposition table */
+void ttResize(size_t megabytes);
+void ttClear(void);
+void ttNewSearch(void);
+void ttPrefetch(U64 key);
+bool ttProbe(U64 key, TTEntry* out);
+void ttStore(U64 key, int depth, int score, int bound, Move best);
+int ttHashfull(void);
+
+/* Polyglot opening book */
+extern bool bookBestOnly;       // always play the highest-weighted move
+U64 polyglotKey(const Board* b);
+bool bookOpen(const char* path);
+void bookClose(void);
+bool bookLoaded(void);
+bool bookProbe(Board* b, bool bestOnly, Move* out);     // bestOnly as bookBestOnly, for one probe
+
+/* EPD batch analysis ("chess epd <file> ...") */
+int runBatch(int argc, char** argv);
+
+/* multi-session UCI server on a Unix domain socket ("chess server <path> ...") */
+int runServer(int argc, char** argv);
+
+/* evaluation parameter files */
+void evalPrepare(void);
+void evalResetParams(void);
+bool evalParamsValid(const EvalParams* p);       // every packed value fits in int16
+bool evalLoadParams(const char* path);           // text, or binary by its magic
+bool evalSaveParams(const char* path);           // binary if the name ends in .bin
+const char* evalParamName(int index, int* element);
+
+/* Texel tuning of the evaluation parameters ("chess tune <data> ...") */
+int runTune(int argc, char** argv);
+
 
 #ifdef __cplusplus
 }
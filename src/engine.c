@@ -0,0 +1,346 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+
+// ----------------- Engine library -----------------
+
+#define ENGINE_STACK_SIZE (32u << 20)   // as for the batch workers
+
+struct EngineContext {
+    Board board;
+    bool stop;                          // SearchLimits.stop of every search
+    bool ponderhit;                     // SearchLimits.ponderhit
+
+    pthread_t thread;
+    pthread_mutex_t callLock;           // one call at a time per context
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    void (*job)(EngineContext* ctx, void* arg);
+    void* jobArg;
+    bool quit;
+};
+
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+
+static void initProcess(void) {
+    initAttackTables();
+    evalResetParams();
+    ttResize(TT_DEFAULT_MB);
+}
+void engineInit(void) {
+    pthread_once(&initOnce, initProcess);
+}
+
+// The context's thread: runs one job at a time until engineDestroy().
+static void* engineWorker(void* arg) {
+    EngineContext* ctx = (EngineContext*) arg;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        while (!ctx->job && !ctx->quit) {
+            pthread_cond_wait(&ctx->wake, &ctx->lock);
+        }
+        if (ctx->quit)
+            break;
+
+        pthread_mutex_unlock(&ctx->lock);
+        ctx->job(ctx, ctx->jobArg);
+        pthread_mutex_lock(&ctx->lock);
+
+        ctx->job = NULL;
+        pthread_cond_broadcast(&ctx->done);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+static void runJob(EngineContext* ctx, void (*job)(EngineContext*, void*), void* arg) {
+    pthread_mutex_lock(&ctx->callLock);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->job = job;
+    ctx->jobArg = arg;
+    pthread_cond_signal(&ctx->wake);
+    while (ctx->job) {
+        pthread_cond_wait(&ctx->done, &ctx->lock);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    pthread_mutex_unlock(&ctx->callLock);
+}
+
+EngineContext* engineCreate(void) {
+    engineInit();
+
+    EngineContext* ctx = (EngineContext*) calloc(1, sizeof(EngineContext));
+    if (!ctx)
+        return NULL;
+    boardSetup(&ctx->board);
+    pthread_mutex_init(&ctx->callLock, NULL);
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wake, NULL);
+    pthread_cond_init(&ctx->done, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, ENGINE_STACK_SIZE);
+    int err = pthread_create(&ctx->thread, &attr, engineWorker, ctx);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        pthread_cond_destroy(&ctx->done);
+        pthread_cond_destroy(&ctx->wake);
+        pthread_mutex_destroy(&ctx->lock);
+        pthread_mutex_destroy(&ctx->callLock);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+void engineDestroy(EngineContext* ctx) {
+    if (!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->callLock);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->quit = true;
+    pthread_cond_signal(&ctx->wake);
+    pthread_mutex_unlock(&ctx->lock);
+    pthread_join(ctx->thread, NULL);
+    pthread_mutex_unlock(&ctx->callLock);
+
+    pthread_cond_destroy(&ctx->done);
+    pthread_cond_destroy(&ctx->wake);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_mutex_destroy(&ctx->callLock);
+    free(ctx);
+}
+
+// ----------------- Position -----------------
+
+typedef struct {
+    const char* fen;
+    const char* moves;
+    bool ok;
+} PositionJob;
+
+static void setPositionJob(EngineContext* ctx, void* arg) {
+    PositionJob* job = (PositionJob*) arg;
+    static _Thread_local U64 keys[MAX_GAME_PLY];
+    int keyCount;
+    Board b;
+
+    job->ok = parsePosition(job->fen, job->moves, &b, keys, &keyCount);
+    if (!job->ok)
+        return;
+
+    ctx->board = b;
+    resetKeyHistory();
+    for (int i = 0; i < keyCount; i++) {
+        pushKeyHistory(keys[i]);
+    }
+}
+bool engineSetPosition(EngineContext* ctx, const char* fen, const char* moves) {
+    PositionJob job = { fen, moves, false };
+    runJob(ctx, setPositionJob, &job);
+    return job.ok;
+}
+void engineGetPosition(EngineContext* ctx, Board* out) {
+    pthread_mutex_lock(&ctx->callLock);
+    *out = ctx->board;
+    pthread_mutex_unlock(&ctx->callLock);
+}
+
+static void newGameJob(EngineContext* ctx, void* arg) {
+    (void)ctx;
+    (void)arg;
+    clearHeuristics();
+    evalCacheClear();
+}
+void engineNewGame(EngineContext* ctx) {
+    runJob(ctx, newGameJob, NULL);
+}
+
+// ----------------- Search -----------------
+
+typedef struct {
+    SearchLimits limits;
+    SearchResult* result;
+    Move best;
+} SearchJob;
+
+static void searchJob(EngineContext* ctx, void* arg) {
+    SearchJob* job = (SearchJob*) arg;
+    job->best = findBestMove(&ctx->board, &job->limits, job->result);
+}
+Move engineSearch(EngineContext* ctx, const SearchLimits* limits,
+                  SearchInfoFn onInfo, void* data, SearchResult* result) {
+    SearchJob job;
+    job.limits = *limits;
+    if (!limits->stop) {
+        job.limits.stop = &ctx->stop;
+    }
+    if (!limits->ponderhit) {
+        job.limits.ponderhit = &ctx->ponderhit;
+    }
+    job.limits.onInfo = onInfo;
+    job.limits.infoData = data;
+    job.limits.silent = limits->silent || !onInfo;
+    job.result = result;
+
+    // cleared before the job is queued, so a stop racing with the start still counts
+    __atomic_store_n(&ctx->stop, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->ponderhit, false, __ATOMIC_RELAXED);
+    runJob(ctx, searchJob, &job);
+    return job.best;
+}
+void engineStop(EngineContext* ctx) {
+    __atomic_store_n(&ctx->stop, true, __ATOMIC_RELAXED);
+}
+void enginePonderhit(EngineContext* ctx) {
+    __atomic_store_n(&ctx->ponderhit, true, __ATOMIC_RELAXED);
+}
+
+// ----------------- Perft / eval / custom jobs -----------------
+
+typedef struct {
+    int depth;
+    uint64_t nodes;
+    int eval;
+} CountJob;
+
+static void perftJob(EngineContext* ctx, void* arg) {
+    CountJob* job = (CountJob*) arg;
+    Board b = ctx->board;
+    job->nodes = countMoves(&b, job->depth);
+}
+uint64_t enginePerft(EngineContext* ctx, int depth) {
+    CountJob job = { depth, 0, 0 };
+    runJob(ctx, perftJob, &job);
+    return job.nodes;
+}
+static void evalJob(EngineContext* ctx, void* arg) {
+    CountJob* job = (CountJob*) arg;
+    Board b = ctx->board;
+    job->eval = evaluate(&b);
+}
+int engineEval(EngineContext* ctx) {
+    CountJob job = { 0, 0, 0 };
+    runJob(ctx, evalJob, &job);
+    return job.eval;
+}
+
+typedef struct {
+    void (*fn)(void* arg);
+    void* arg;
+} CustomJob;
+
+static void customJob(EngineContext* ctx, void* arg) {
+    (void)ctx;
+    CustomJob* job = (CustomJob*) arg;
+    job->fn(job->arg);
+}
+void engineRun(EngineContext* ctx, void (*fn)(void* arg), void* arg) {
+    CustomJob job = { fn, arg };
+    runJob(ctx, customJob, &job);
+}
+
+// ----------------- UCI helpers -----------------
+
+// The legal move written as text (e2e4, e7e8q), if there is one.
+static bool findUciMove(Board* b, const char* text, size_t len, Move* out) {
+    Move legal[256];
+    uint64_t count = 0;
+    generateLegalMovesToArray(b, legal, &count, 256);
+
+    for (uint64_t i = 0; i < count; i++) {
+        char buf[6];
+        moveToString(legal[i], buf);
+        if (strlen(buf) == len && !strncmp(buf, text, len)) {
+            *out = legal[i];
+            return true;
+        }
+    }
+    return false;
+}
+bool parsePosition(const char* fen, const char* moves, Board* out, U64 keys[MAX_GAME_PLY], int* keyCount) {
+    Board b;
+    int count = 0;
+
+    if (!fen || !strcmp(fen, "startpos")) {
+        boardSetup(&b);
+    } else if (!parseFEN(&b, fen)) {
+        return false;
+    }
+
+    const char* p = moves ? moves : "";
+    for (;;) {
+        p += strspn(p, " \t\r\n");
+        size_t len = strcspn(p, " \t\r\n");
+        if (!len)
+            break;
+
+        Move m;
+        if (count == MAX_GAME_PLY || !findUciMove(&b, p, len, &m))
+            return false;
+        Undo u;
+        keys[count++] = b.key;
+        applyMove(&b, m, &u);
+        p += len;
+    }
+
+    *out = b;
+    *keyCount = count;
+    return true;
+}
+void splitPositionCommand(char* line, char** fen, char** moves) {
+    line[strcspn(line, "\r\n")] = '\0';
+    *moves = strstr(line, "moves");
+    if (*moves) {
+        **moves = '\0';
+        *moves += 5;
+    }
+    *fen = strstr(line, "fen ");
+    if (*fen) {
+        *fen += 4;
+    }
+}
+// Reads "go" parameters; with no depth, node or clock limit given (and not
+// infinite), falls back to depth 4. A bare "go ponder" gets it too: it
+// searches to depth 4, then holds its bestmove until ponderhit or stop.
+void parseGoLimits(const char* line, const Board* board, SearchLimits* limits) {
+    memset(limits, 0, sizeof(*limits));
+
+    const char* p;
+    long long value;
+    if ((p = strstr(line, "depth")) && sscanf(p, "depth %lld", &value) == 1) {
+        limits->depth = (int)value;
+    }
+    if ((p = strstr(line, "movetime")) && sscanf(p, "movetime %lld", &value) == 1) {
+        limits->moveTimeMs = value;
+    }
+    if ((p = strstr(line, "movestogo")) && sscanf(p, "movestogo %lld", &value) == 1) {
+        limits->movesToGo = (int)value;
+    }
+    if ((p = strstr(line, "nodes")) && sscanf(p, "nodes %lld", &value) == 1 && value > 0) {
+        limits->nodes = (uint64_t)value;
+    }
+
+    const char* timeKey = (board->mover == WHITE) ? "wtime" : "btime";
+    const char* incKey  = (board->mover == WHITE) ? "winc" : "binc";
+    if ((p = strstr(line, timeKey)) && sscanf(p + 5, " %lld", &value) == 1) {
+        limits->timeLeftMs = value;
+    }
+    if ((p = strstr(line, incKey)) && sscanf(p + 4, " %lld", &value) == 1) {
+        limits->incrementMs = value;
+    }
+
+    // "ponder" is a word of its own; "ponderhit" never reaches here
+    limits->ponder = strstr(line, " ponder") != NULL;
+    limits->infinite = strstr(line, " infinite") != NULL;
+
+    if (!limits->depth && !limits->moveTimeMs && !limits->timeLeftMs && !limits->nodes &&
+        !limits->infinite) {
+        limits->depth = 4;
+    }
+}
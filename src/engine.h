@@ -0,0 +1,87 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "bitboard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Embeddable engine API (libchessengine.a / libchessengine.so).
+ *
+ * An EngineContext is one independent engine: a position with its game
+ * history, the move-ordering tables and evaluation cache, and a stop flag.
+ * Search state is thread-local in this engine, so every context owns a
+ * worker thread (with a stack large enough for MAX_DEPTH) and runs all of
+ * its calls there; the calling thread just waits. Calls on one context are
+ * serialized, different contexts search in parallel.
+ *
+ * Shared by all contexts: the transposition table, the opening book, the
+ * tablebases and the evaluation parameters. Change those (ttResize(),
+ * bookOpen(), tbInit(), evalLoadParams()) only while no search runs. A
+ * deterministic search clears the shared table, so it is only reproducible
+ * when no other context is searching.
+ */
+
+typedef struct EngineContext EngineContext;
+
+/* process-wide setup, done once; engineCreate() calls it */
+void engineInit(void);
+
+EngineContext* engineCreate(void);
+void engineDestroy(EngineContext* ctx);
+
+/*
+ * fen == NULL or "startpos" is the initial position; moves is a list of
+ * UCI moves separated by spaces, or NULL. Every move must be legal. On
+ * failure the context keeps its previous position.
+ */
+bool engineSetPosition(EngineContext* ctx, const char* fen, const char* moves);
+void engineGetPosition(EngineContext* ctx, Board* out);
+
+/* forget the ordering tables and eval cache (not the shared TT) */
+void engineNewGame(EngineContext* ctx);
+
+/*
+ * Searches the current position and returns the best move (from == -1 if
+ * there is no legal move). onInfo receives a report per finished iteration
+ * and line, on the context's thread; with onInfo == NULL the search is
+ * silent. A book move is reported once with depth 0. onInfo and infoData
+ * replace the ones in limits; a NULL limits->stop or limits->ponderhit
+ * means the context's own flags, cleared here. A caller that starts the
+ * search on another thread passes flags of its own instead, cleared before
+ * the thread starts, so that a stop sent right after it is never lost.
+ * result->ponder is the reply the PV expects.
+ */
+Move engineSearch(EngineContext* ctx, const SearchLimits* limits,
+                  SearchInfoFn onInfo, void* data, SearchResult* result);
+
+/* abort a running engineSearch() from any thread; no-op when idle */
+void engineStop(EngineContext* ctx);
+/*
+ * The ponder move was played: a search started with limits->ponder keeps
+ * its tree and TT and now runs on its clock limits, counted from here.
+ * Ponder and infinite searches do not return before this or engineStop().
+ */
+void enginePonderhit(EngineContext* ctx);
+
+uint64_t enginePerft(EngineContext* ctx, int depth);
+int engineEval(EngineContext* ctx);                 // centipawns, side to move
+
+/* run fn(arg) on the context's thread, e.g. to read its statistics */
+void engineRun(EngineContext* ctx, void (*fn)(void* arg), void* arg);
+
+/* UCI text helpers for front ends */
+// FEN (NULL or "startpos" for the initial position) plus UCI moves; keys
+// receives the key before every move, for the repetition history
+bool parsePosition(const char* fen, const char* moves, Board* out, U64 keys[MAX_GAME_PLY], int* keyCount);
+// cuts "position [startpos | fen F] [moves M...]" in place, fen/moves NULL if absent
+void splitPositionCommand(char* line, char** fen, char** moves);
+void parseGoLimits(const char* line, const Board* board, SearchLimits* limits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENGINE_H */
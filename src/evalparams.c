@@ -0,0 +1,248 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitboard.h"
+
+// ----------------- Evaluation parameters -----------------
+
+EvalParams evalParams;
+EvalTerms evalTerms;
+Score pieceSquareScore[16][64];
+uint32_t evalGeneration;
+
+/*
+ * Text files list "name value..." with the values of each field in
+ * declaration order (tables a1 first); '#' starts a comment and fields
+ * may be left out to keep their defaults. Binary files are the magic,
+ * a version, the number of values and then every int of EvalParams as
+ * little-endian int32.
+ */
+
+#define EVAL_FILE_MAGIC "CEVP"
+#define EVAL_FILE_VERSION 1
+
+#define FIELD(name, member, count) { name, offsetof(EvalParams, member) / sizeof(int), count }
+
+static const struct { const char* name; size_t index; int count; } evalFields[] = {
+    FIELD("material",         material,            7),
+    FIELD("pst_pawn_mg",      pst[PAWN][MG],      64),
+    FIELD("pst_pawn_eg",      pst[PAWN][EG],      64),
+    FIELD("pst_knight_mg",    pst[KNIGHT][MG],    64),
+    FIELD("pst_knight_eg",    pst[KNIGHT][EG],    64),
+    FIELD("pst_bishop_mg",    pst[BISHOP][MG],    64),
+    FIELD("pst_bishop_eg",    pst[BISHOP][EG],    64),
+    FIELD("pst_rook_mg",      pst[ROOK][MG],      64),
+    FIELD("pst_rook_eg",      pst[ROOK][EG],      64),
+    FIELD("pst_queen_mg",     pst[QUEEN][MG],     64),
+    FIELD("pst_queen_eg",     pst[QUEEN][EG],     64),
+    FIELD("pst_king_mg",      pst[KING][MG],      64),
+    FIELD("pst_king_eg",      pst[KING][EG],      64),
+    FIELD("doubled_pawn",     doubledPawn,         1),
+    FIELD("isolated_pawn",    isolatedPawn,        2),
+    FIELD("passed_pawn",      passedPawn,          2),
+    FIELD("mobility",         mobility,           14),
+    FIELD("hanging_piece",    hangingPiece,        2),
+    FIELD("king_zone_attack", kingZoneAttack,      1),
+    FIELD("king_back_rank",   kingBackRank,        1),
+    FIELD("king_exposed",     kingExposed,         1),
+    FIELD("king_shield_pawn", kingShieldPawn,      1),
+};
+
+#define EVAL_FIELD_COUNT ((int)(sizeof(evalFields) / sizeof(evalFields[0])))
+
+/*
+ * Black uses the white tables mirrored vertically (sq ^ 56) and negated,
+ * so evaluate() only ever adds. The kings' material is left out: it always
+ * cancels and would push the packed halves out of int16.
+ */
+void evalPrepare(void) {
+    const EvalParams* p = &evalParams;
+    memset(pieceSquareScore, 0, sizeof(pieceSquareScore));
+
+    for (int piece = PAWN; piece <= KING; piece++) {
+        int material = piece == KING ? 0 : p->material[piece];
+        for (int sq = 0; sq < 64; sq++) {
+            Score s = makeScore(material + p->pst[piece][MG][sq], material + p->pst[piece][EG][sq]);
+            pieceSquareScore[piece | WHITE][sq] = s;
+            pieceSquareScore[piece | BLACK][sq ^ 56] = -s;
+        }
+    }
+
+    EvalTerms* t = &evalTerms;
+    t->doubledPawn = makeScore(p->doubledPawn, p->doubledPawn);
+    t->isolatedPawn = makeScore(p->isolatedPawn[MG], p->isolatedPawn[EG]);
+    t->passedPawn = makeScore(p->passedPawn[MG], p->passedPawn[EG]);
+    for (int piece = 0; piece < 7; piece++) {
+        t->mobility[piece] = makeScore(p->mobility[piece][MG], p->mobility[piece][EG]);
+    }
+    t->hangingPiece = makeScore(p->hangingPiece[MG], p->hangingPiece[EG]);
+    t->kingZoneAttack = makeScore(p->kingZoneAttack, 0);
+    t->kingBackRank = makeScore(p->kingBackRank, 0);
+    t->kingExposed = makeScore(p->kingExposed, 0);
+    t->kingShieldPawn = makeScore(p->kingShieldPawn, 0);
+
+    evalGeneration++;
+}
+
+/*
+ * makeScore() packs each phase into an int16 half, so every value and every
+ * material + square sum evalPrepare() builds must fit there; anything larger
+ * would silently bleed into the other half. Loaded and tuned parameters are
+ * checked before they replace evalParams.
+ */
+bool evalParamsValid(const EvalParams* p) {
+    const int* values = (const int*)p;
+    for (int i = 0; i < EVAL_PARAM_COUNT; i++) {
+        if (values[i] < INT16_MIN || values[i] > INT16_MAX)
+            return false;
+    }
+    for (int piece = PAWN; piece < KING; piece++) {
+        for (int phase = MG; phase <= EG; phase++) {
+            for (int sq = 0; sq < 64; sq++) {
+                int v = p->material[piece] + p->pst[piece][phase][sq];
+                if (v < INT16_MIN || v > INT16_MAX)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+void evalResetParams(void) {
+    evalParams = defaultEvalParams;
+    evalPrepare();
+}
+
+// Field name and element of a flat parameter index; NULL for unused slots.
+const char* evalParamName(int index, int* element) {
+    for (int i = 0; i < EVAL_FIELD_COUNT; i++) {
+        int first = (int)evalFields[i].index;
+        if (index >= first && index < first + evalFields[i].count) {
+            if (element) *element = index - first;
+            return evalFields[i].name;
+        }
+    }
+    return NULL;
+}
+
+static bool loadBinary(FILE* f, EvalParams* out) {
+    unsigned char header[12];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header))
+        return false;
+    unsigned version = header[4] | header[5] << 8 | header[6] << 16 | (unsigned)header[7] << 24;
+    unsigned count = header[8] | header[9] << 8 | header[10] << 16 | (unsigned)header[11] << 24;
+    if (version != EVAL_FILE_VERSION || count != (unsigned)EVAL_PARAM_COUNT)
+        return false;
+
+    int* values = (int*)out;
+    for (int i = 0; i < EVAL_PARAM_COUNT; i++) {
+        unsigned char v[4];
+        if (fread(v, 1, 4, f) != 4)
+            return false;
+        values[i] = (int32_t)(v[0] | v[1] << 8 | v[2] << 16 | (uint32_t)v[3] << 24);
+    }
+    return true;
+}
+
+static bool loadText(FILE* f, EvalParams* out) {
+    int* values = (int*)out;
+    int field = -1, filled = 0;
+    char token[64];
+
+    for (;;) {
+        int c = fgetc(f);
+        while (c != EOF && (isspace(c) || c == '#')) {
+            if (c == '#') {
+                while (c != EOF && c != '\n') c = fgetc(f);
+            }
+            c = fgetc(f);
+        }
+        if (c == EOF)
+            break;
+
+        size_t len = 0;
+        while (c != EOF && !isspace(c) && c != '#') {
+            if (len < sizeof(token) - 1) token[len++] = (char)c;
+            c = fgetc(f);
+        }
+        token[len] = '\0';
+        if (c != EOF) ungetc(c, f);
+
+        if (isalpha((unsigned char)token[0]) || token[0] == '_') {
+            if (field >= 0 && filled != evalFields[field].count)
+                return false;
+            for (field = 0; field < EVAL_FIELD_COUNT && strcmp(evalFields[field].name, token); field++) {}
+            if (field == EVAL_FIELD_COUNT)
+                return false;
+            filled = 0;
+        } else {
+            char* end;
+            long v = strtol(token, &end, 10);
+            if (field < 0 || *end || filled == evalFields[field].count || v < INT16_MIN || v > INT16_MAX)
+                return false;
+            values[evalFields[field].index + (size_t)filled++] = (int)v;
+        }
+    }
+    return field < 0 || filled == evalFields[field].count;
+}
+
+bool evalLoadParams(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    EvalParams loaded = defaultEvalParams;
+    char magic[4];
+    bool binary = fread(magic, 1, 4, f) == 4 && !memcmp(magic, EVAL_FILE_MAGIC, 4);
+    rewind(f);
+    bool ok = binary ? loadBinary(f, &loaded) : loadText(f, &loaded);
+    fclose(f);
+    ok = ok && evalParamsValid(&loaded);
+
+    if (ok) {
+        evalParams = loaded;
+        evalPrepare();
+    }
+    return ok;
+}
+
+bool evalSaveParams(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    const int* values = (const int*)&evalParams;
+    size_t len = strlen(path);
+    if (len >= 4 && !strcmp(path + len - 4, ".bin")) {
+        unsigned char header[12] = { 'C', 'E', 'V', 'P' };
+        unsigned words[2] = { EVAL_FILE_VERSION, (unsigned)EVAL_PARAM_COUNT };
+        for (int w = 0; w < 2; w++) {
+            for (int k = 0; k < 4; k++) header[4 + w * 4 + k] = (unsigned char)(words[w] >> (8 * k));
+        }
+        fwrite(header, 1, sizeof(header), f);
+        for (int i = 0; i < EVAL_PARAM_COUNT; i++) {
+            uint32_t v = (uint32_t)values[i];
+            unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8),
+                                   (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+            fwrite(b, 1, 4, f);
+        }
+    } else {
+        fprintf(f, "# evaluation parameters: name, then its values (tables a1..h8)\n");
+        for (int i = 0; i < EVAL_FIELD_COUNT; i++) {
+            const int* v = values + evalFields[i].index;
+            int count = evalFields[i].count;
+            fprintf(f, "%s", evalFields[i].name);
+            if (count == 64) {
+                for (int sq = 0; sq < 64; sq++) {
+                    fprintf(f, "%s%5d", sq % 8 == 0 ? "\n   " : "", v[sq]);
+                }
+            } else {
+                for (int k = 0; k < count; k++) fprintf(f, " %d", v[k]);
+            }
+            fprintf(f, "\n");
+        }
+    }
+    return fclose(f) == 0;
+}
@@ -1,10 +1,34 @@
 #include "bitboard.h"
+#include "syzygy.h"
+#include "trace.h"
 #include <stdbool.h>
 #include <string.h>
-
-Move killerMoves[KILLERS_PER_DEPTH][MAX_DEPTH];
-static int historyTable[64][64];
-
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Move ordering state. It lives for the whole game: only the killers are
+ * reset for each new search, history tables are halved by ageHeuristics()
+ * and everything is cleared by clearHeuristics() on ucinewgame.
+ * All search state is thread-local so that batch workers can run
+ * independent searches; only the transposition table is shared.
+ */
+static _Thread_local Move killerMoves[MAX_DEPTH][KILLERS_PER_DEPTH];
+static _Thread_local int historyTable[2][64][64];
+static _Thread_local Move counterMoves[16][64];
+static _Thread_local int16_t continuationHistory[16][64][16][64];
+
+// Piece and destination of the move made at each ply (root move at ply 0);
+// piece 0 means "no move", which indexes an always-empty table slice.
+typedef struct {
+    int piece;
+    int to;
+} PlyMove;
+static _Thread_local PlyMove searchStack[MAX_DEPTH + 1];
+
+// 0 with every piece on the board, MAX_PHASE once only pawns and kings are left.
 int computePhase(const Board* board) {
     int phase = MAX_PHASE;
 
@@ -87,21 +111,21 @@ int passedPawns(const Board * board, const int color){
     return count;
 }
 
-static inline int kingSafetyMG(const Board *b, const int color) {
+static inline Score kingSafety(const Board *b, const AttackInfo *ai, const int color) {
     U64 king = (color == WHITE) ? b->wk : b->bk;
-    if (!king) return -200; // mate situation
+    if (!king) return makeScore(-200, 0); // mate situation
 
     int sq = __builtin_ctzll(king);
     int r = sq >> 3;
     int f = sq & 7;
 
-    int score = 0;
+    Score score = 0;
 
     // Castling / back rank safety
     if ((color == WHITE && r <= 1) || (color == BLACK && r >= 6))
-        score += 10;
+        score += evalTerms.kingBackRank;
     else
-        score -= 5;
+        score += evalTerms.kingExposed;
 
     // Pawn shield
     int dir = (color == WHITE) ? 1 : -1;
@@ -113,42 +137,26 @@ static inline int kingSafetyMG(const Board *b, const int color) {
             int ff = f + df;
             if (ff < 0 || ff > 7) continue;
             if (pawns & bit(fr * 8 + ff))
-                score += 5;
+                score += evalTerms.kingShieldPawn;
         }
     }
 
-    return score;
-}
-
-int knightMobility(const Board *b, const int color) {
-    U64 knights = (color == WHITE) ? b->wn : b->bn;
-    U64 own = (color == WHITE) ? b->whitePieces : b->blackPieces;
-    int m = 0;
+    // Enemy attacks on the king and the squares around it
+    U64 zone = kingAttacks[sq] | king;
+    score += evalTerms.kingZoneAttack *
+             __builtin_popcountll(zone & ai->attacked[colorIndex(color) ^ 1]);
 
-    while (knights) {
-        int sq = pop_lsb(&knights);
-        m += __builtin_popcountll(knightAttacks[sq] & ~own);
-    }
-    return m;
+    return score;
 }
-int bishopMobility(const Board *b, const int color) {
-    U64 bishops = (color == WHITE) ? b->wb : b->bb;
-    const U64 own = (color == WHITE) ? b->whitePieces : b->blackPieces;
-    int m = 0;
 
-    while (bishops) {
-        const int sq = pop_lsb(&bishops);
-        m += __builtin_popcountll(bishopAttacks[sq] & ~own);
-    }
-    return m;
-}
+// Non-pawn pieces attacked by the enemy and not defended at all.
+static inline int hangingPieces(const Board *b, const AttackInfo *ai, const int color) {
+    int c = colorIndex(color);
+    U64 pieces = (color == WHITE)
+        ? (b->wn | b->wb | b->wr | b->wq)
+        : (b->bn | b->bb | b->br | b->bq);
 
-bool inCheck_bit(const Board* board, const int color){
-    U64 kings = (color == WHITE) ? board->wk : board->bk;
-    if (!kings) return false;
-    int kingSq = __builtin_ctzll(kings);
-    int kr = rankOf(kingSq), kf = fileOf(kingSq);
-    return isAttacked(*board, kr, kf, color);
+    return __builtin_popcountll(pieces & ai->attacked[c ^ 1] & ~ai->attacked[c]);
 }
 
 static inline int isCapture(const Board *b, const Move m) {
@@ -170,54 +178,17 @@ int pieceValue(const int piece){
         default:     return 0;
     }
 }
-int getCapturedPiece(const Board *b, const int toSq) {
-    U64 toBB = 1ULL << toSq;
-
-    if (b->mover == WHITE) {
-        if (b->bp & toBB) return 0;
-        if (b->bn & toBB) return 1;
-        if (b->bb & toBB) return 2;
-        if (b->br & toBB) return 3;
-        if (b->bq & toBB) return 4;
-        if (b->bk & toBB) return 5;
-    } else {
-        if (b->wp & toBB) return 0;
-        if (b->wn & toBB) return 1;
-        if (b->wb & toBB) return 2;
-        if (b->wr & toBB) return 3;
-        if (b->wq & toBB) return 4;
-        if (b->wk & toBB) return 5;
-    }
-
-    return -1;
-}
-int getAttackerPiece(const Board *b, const int fromSq) {
-    U64 fromBB = 1ULL << fromSq;
-
-    if (b->mover == WHITE) {
-        if (b->wp & fromBB) return 0;
-        if (b->wn & fromBB) return 1;
-        if (b->wb & fromBB) return 2;
-        if (b->wr & fromBB) return 3;
-        if (b->wq & fromBB) return 4;
-        if (b->wk & fromBB) return 5;
-    } else {
-        if (b->bp & fromBB) return 0;
-        if (b->bn & fromBB) return 1;
-        if (b->bb & fromBB) return 2;
-        if (b->br & fromBB) return 3;
-        if (b->bq & fromBB) return 4;
-        if (b->bk & fromBB) return 5;
-    }
-
-    return -1;
+// MVV-LVA index (pawn 0 .. king 5) of the piece of color on the square, -1 if none.
+SPECIALIZED int pieceIndexAs(const Board *b, int sq, int color) {
+    int piece = pieceOfColorAt(b, bit(sq), color);
+    return piece ? (piece & 7) - 1 : -1;
 }
 bool sameMove(const Move *a, const Move *b) {
     return a->from == b->from &&
            a->to == b->to &&
            a->promotionPiece == b->promotionPiece;
 }
-int scoreMove(const Board *b, const Move *m, const int ply) {
+SPECIALIZED int scoreMoveAs(const Board *b, const Move *m, const int ply, const int us) {
 
     /* ================= PROMOTIONS ================= */
 
@@ -227,9 +198,9 @@ int scoreMove(const Board *b, const Move *m, const int ply) {
 
     /* ================= CAPTURES ================= */
 
-    int victim = getCapturedPiece(b, m->to);
+    int victim = pieceIndexAs(b, m->to, us ^ COLOR_MASK);
     if (victim != -1) {
-        int attacker = getAttackerPiece(b, m->from);
+        int attacker = pieceIndexAs(b, m->from, us);
         if (attacker == -1)
             return SCORE_CAPTURE;
 
@@ -238,20 +209,46 @@ int scoreMove(const Board *b, const Move *m, const int ply) {
 
     /* ================= KILLERS ================= */
 
-    if (sameMove(m, &killerMoves[0][ply]))
+    if (sameMove(m, &killerMoves[ply][0]))
         return SCORE_KILLER;
 
-    if (sameMove(m, &killerMoves[1][ply]))
+    if (sameMove(m, &killerMoves[ply][1]))
         return SCORE_KILLER - 1;
 
+    /* ================= COUNTER MOVE ================= */
+
+    const PlyMove *prev1 = ply >= 1 ? &searchStack[ply - 1] : &searchStack[MAX_DEPTH];
+    const PlyMove *prev2 = ply >= 2 ? &searchStack[ply - 2] : &searchStack[MAX_DEPTH];
+
+    if (prev1->piece && sameMove(m, &counterMoves[prev1->piece][prev1->to]))
+        return SCORE_COUNTER;
+
     /* ================= HISTORY ================= */
 
-    return SCORE_HISTORY + historyTable[m->from][m->to];
+    int piece = pieceOfColorAt(b, bit(m->from), us);
+    return SCORE_HISTORY
+         + historyTable[colorIndex(us)][m->from][m->to]
+         + continuationHistory[prev1->piece][prev1->to][piece][m->to]
+         + continuationHistory[prev2->piece][prev2->to][piece][m->to];
+}
+int scoreMove(const Board *b, const Move *m, const int ply) {
+    return b->mover == WHITE ? scoreMoveAs(b, m, ply, WHITE) : scoreMoveAs(b, m, ply, BLACK);
 }
-static void orderMoves(const Board *b, Move *moves, const uint64_t count, const int depth) {
+SPECIALIZED void scoreMovesAs(const Board *b, Move *moves, const uint64_t count, const int ply,
+                              const Move *ttMove, const int us) {
     for (uint64_t i = 0; i < count; i++) {
-        moves[i].score = scoreMove(b, &moves[i], depth);
+        if (ttMove && sameMove(&moves[i], ttMove))
+            moves[i].score = SCORE_TT_MOVE;
+        else
+            moves[i].score = scoreMoveAs(b, &moves[i], ply, us);
     }
+}
+static void orderMoves(const Board *b, Move *moves, const uint64_t count, const int ply,
+                       const Move *ttMove) {
+    if (b->mover == WHITE)
+        scoreMovesAs(b, moves, count, ply, ttMove, WHITE);
+    else
+        scoreMovesAs(b, moves, count, ply, ttMove, BLACK);
 
     for (uint64_t i = 0; i+1 < count; i++) {
         for (uint64_t j = i + 1; j < count; j++) {
@@ -264,12 +261,296 @@ static void orderMoves(const Board *b, Move *moves, const uint64_t count, const
     }
 }
 
-// ----------------------------------------------------------
-int quiescence(Board *b, int alpha, int beta) {
-    int stand_pat = evaluate(b);
+// History gravity: entries saturate at +-HISTORY_MAX instead of growing
+// without bound, so recent results keep being able to change the order.
+static inline int historyGravity(int value, int bonus) {
+    return value + bonus - value * abs(bonus) / HISTORY_MAX;
+}
+static void updateQuietHistory(const Board *b, const Move *m, int ply, int bonus) {
+    int side = colorIndex(b->mover);
+    int piece = pieceAt(b, m->from);
+    int *h = &historyTable[side][m->from][m->to];
+    *h = historyGravity(*h, bonus);
+
+    for (int back = 1; back <= 2 && back <= ply; back++) {
+        const PlyMove *prev = &searchStack[ply - back];
+        if (!prev->piece) continue;
+        int16_t *c = &continuationHistory[prev->piece][prev->to][piece][m->to];
+        *c = (int16_t)historyGravity(*c, bonus);
+    }
+}
+// A quiet move caused a beta cutoff: reward it, penalise the quiet moves
+// searched before it, and remember it as killer / counter move.
+static void updateQuietStats(const Board *b, const Move *best, const Move *quiets,
+                             int quietCount, int ply, int depth) {
+    int bonus = depth * depth * 32;
+    if (bonus > HISTORY_BONUS_MAX) bonus = HISTORY_BONUS_MAX;
+
+    updateQuietHistory(b, best, ply, bonus);
+    for (int i = 0; i < quietCount; i++) {
+        updateQuietHistory(b, &quiets[i], ply, -bonus);
+    }
+
+    if (!sameMove(best, &killerMoves[ply][0])) {
+        killerMoves[ply][1] = killerMoves[ply][0];
+        killerMoves[ply][0] = *best;
+    }
+
+    if (ply >= 1 && searchStack[ply - 1].piece) {
+        counterMoves[searchStack[ply - 1].piece][searchStack[ply - 1].to] = *best;
+    }
+}
+void clearHeuristics(void) {
+    memset(killerMoves, 0, sizeof(killerMoves));
+    memset(historyTable, 0, sizeof(historyTable));
+    memset(counterMoves, 0, sizeof(counterMoves));
+    memset(continuationHistory, 0, sizeof(continuationHistory));
+}
+void ageHeuristics(void) {
+    memset(killerMoves, 0, sizeof(killerMoves));
+
+    int *h = &historyTable[0][0][0];
+    for (size_t i = 0; i < sizeof(historyTable) / sizeof(int); i++) {
+        h[i] /= 2;
+    }
+    int16_t *c = &continuationHistory[0][0][0][0];
+    for (size_t i = 0; i < sizeof(continuationHistory) / sizeof(int16_t); i++) {
+        c[i] /= 2;
+    }
+}
+
+// -------------------- Search --------------------
+
+_Thread_local uint64_t nodesSearched = 0;
+
+static _Thread_local bool searchStopped = false;
+static _Thread_local double searchStart = 0.0;
+static _Thread_local double softDeadline = 0.0;  // don't start another iteration after this
+static _Thread_local double hardDeadline = 0.0;  // abort the search at this point (0 = none)
+static _Thread_local uint64_t nodeLimit = 0;     // abort after this many nodes (0 = none)
+static _Thread_local uint64_t softNodeLimit = 0; // deterministic softDeadline (0 = none)
+static _Thread_local bool searchDeterministic = false;
+static _Thread_local int selDepth = 0;
+static _Thread_local uint64_t tbHits = 0;
+static _Thread_local int tbProbeLimit = 0;        // most pieces probed in the tree, 0 = off
+static _Thread_local const bool* stopSignal = NULL;  // SearchLimits.stop
+static _Thread_local const bool* ponderhitSignal = NULL;
+static _Thread_local bool searchPondering = false;   // clock limits not running yet
+static _Thread_local const SearchLimits* searchLimits = NULL;
+
+// Triangular principal variation: pvTable[ply] holds the line from ply on.
+static _Thread_local Move pvTable[MAX_DEPTH + 1][MAX_DEPTH + 1];
+static _Thread_local int pvLength[MAX_DEPTH + 1];
+
+typedef struct {
+    Move move;
+    int score;
+    uint64_t nodes;             // size of this move's subtree in the last iteration
+    Move pv[MAX_DEPTH + 1];     // line found for this move, pv[0] == move
+    int pvLength;
+} RootMove;
+
+static _Thread_local RootMove rootMoves[256];
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+static void setupDeadlines(const SearchLimits *limits, double start, uint64_t startNodes);
+
+// On ponderhit the clock limits of "go ponder" start counting, in the same search.
+static void checkPonderhit(void) {
+    if (searchPondering && ponderhitSignal && __atomic_load_n(ponderhitSignal, __ATOMIC_RELAXED)) {
+        searchPondering = false;
+        setupDeadlines(searchLimits, nowSeconds(), nodesSearched);
+    }
+}
+// Called before a node is counted, so a node limit is never overshot.
+static inline bool shouldStop(void) {
+    if (nodeLimit && nodesSearched >= nodeLimit) {
+        searchStopped = true;
+    }
+    if ((nodesSearched & 1023) == 0) {
+        checkPonderhit();
+        if ((hardDeadline > 0.0 && nowSeconds() >= hardDeadline) ||
+            (stopSignal && __atomic_load_n(stopSignal, __ATOMIC_RELAXED))) {
+            searchStopped = true;
+        }
+    }
+    return searchStopped;
+}
+
+// -------------------- Evaluation cache --------------------
+
+/*
+ * Direct-mapped, one 64-bit word per slot: the upper 48 bits of the
+ * Zobrist key above the 16-bit score (side to move's view). The low key
+ * bits pick the slot, so together they cover the whole key. Each search
+ * thread has its own table; it is dropped whenever evalPrepare() has run
+ * since the thread last used it. Only full evaluations are stored, never
+ * the lazy estimates.
+ */
+#define EVAL_CACHE_SIZE ((size_t)1 << EVAL_CACHE_BITS)
+#define EVAL_KEY_MASK (~(uint64_t)0xFFFF)
+
+static _Thread_local uint64_t evalCache[EVAL_CACHE_SIZE];
+static _Thread_local uint32_t evalCacheGeneration;
+static _Thread_local uint64_t evalCacheProbes, evalCacheHits, evalCacheStores;
+
+void evalCacheClear(void) {
+    memset(evalCache, 0, sizeof(evalCache));
+    evalCacheGeneration = evalGeneration;
+    evalCacheProbes = evalCacheHits = evalCacheStores = 0;
+}
+void evalCacheGetStats(EvalCacheStats* out) {
+    size_t used = 0;
+    for (size_t i = 0; i < EVAL_CACHE_SIZE; i++) {
+        used += evalCache[i] != 0;
+    }
+    out->probes = evalCacheProbes;
+    out->hits = evalCacheHits;
+    out->stores = evalCacheStores;
+    out->entries = EVAL_CACHE_SIZE;
+    out->used = used;
+}
+static inline bool evalCacheProbe(U64 key, int* score) {
+    uint64_t e = evalCache[key & (EVAL_CACHE_SIZE - 1)];
+    evalCacheProbes++;
+    if (e && ((e ^ key) & EVAL_KEY_MASK) == 0) {
+        evalCacheHits++;
+        *score = (int16_t)(uint16_t)e;
+        return true;
+    }
+    return false;
+}
+static inline void evalCacheStore(U64 key, int score) {
+    evalCacheStores++;
+    evalCache[key & (EVAL_CACHE_SIZE - 1)] = (key & EVAL_KEY_MASK) | (uint16_t)score;
+}
+
+static inline Score pieceSquares(U64 pieces, int code) {
+    const Score *table = pieceSquareScore[code];
+    Score s = 0;
+    while (pieces) {
+        s += table[pop_lsb(&pieces)];
+    }
+    return s;
+}
+
+/* ================= MATERIAL + PST ================= */
+
+static inline Score materialScore(const Board *b) {
+    Score score = 0;    // middlegame and endgame, see makeScore()
+
+    score += pieceSquares(b->wp, PAWN | WHITE);
+    score += pieceSquares(b->wn, KNIGHT | WHITE);
+    score += pieceSquares(b->wb, BISHOP | WHITE);
+    score += pieceSquares(b->wr, ROOK | WHITE);
+    score += pieceSquares(b->wq, QUEEN | WHITE);
+    score += pieceSquares(b->wk, KING | WHITE);
+
+    score += pieceSquares(b->bp, PAWN | BLACK);
+    score += pieceSquares(b->bn, KNIGHT | BLACK);
+    score += pieceSquares(b->bb, BISHOP | BLACK);
+    score += pieceSquares(b->br, ROOK | BLACK);
+    score += pieceSquares(b->bq, QUEEN | BLACK);
+    score += pieceSquares(b->bk, KING | BLACK);
+
+    return score;
+}
 
-    if (stand_pat >= beta)
+// Everything that needs more than a table lookup per piece.
+static Score positionalScore(const Board *b, const AttackInfo *ai) {
+    const EvalTerms *t = &evalTerms;
+    Score score = 0;
+
+
+    /* ================= PAWN STRUCTURE ================= */
+
+    int dp = doubledPawns(b, WHITE) - doubledPawns(b, BLACK);
+    int ip = isolatedPawns(b, WHITE) - isolatedPawns(b, BLACK);
+    int pp = passedPawns(b, WHITE) - passedPawns(b, BLACK);
+
+    // the doubled / isolated parameters are negative: penalties
+    score += t->doubledPawn * dp;
+    score += t->isolatedPawn * ip;
+    score += t->passedPawn * pp;
+
+
+    /* ================= POSITIONAL ================= */
+
+    score += kingSafety(b, ai, WHITE);
+    score -= kingSafety(b, ai, BLACK);
+
+    int hanging = hangingPieces(b, ai, WHITE) - hangingPieces(b, ai, BLACK);
+    score += t->hangingPiece * hanging;
+
+    /* ================= MOBILITY ================= */
+
+    const int (*mob)[7] = ai->mobility;
+
+    for (int piece = KNIGHT; piece <= QUEEN; piece++) {
+        score += t->mobility[piece] * (mob[0][piece] - mob[1][piece]);
+    }
+
+    return score;
+}
+
+/* ================= PHASE ================= */
+
+// Blend a packed score by game phase, from the side to move's view.
+static inline int taper(const Board *b, Score score, int phase) {
+    int s = (mgValue(score) * (MAX_PHASE - phase) + egValue(score) * phase) / MAX_PHASE;
+    return b->mover == WHITE ? s : -s;
+}
+
+int quiescence(Board *b, int alpha, int beta, int ply) {
+    if (shouldStop())
+        return 0;
+    nodesSearched++;
+    STAT_INC(qnodes);
+    if (ply > selDepth)
+        selDepth = ply;
+
+    int stand_pat;
+    bool cached = evalCacheProbe(b->key, &stand_pat);
+
+    // Material and piece-squares first: the remaining terms rarely move the
+    // score by more than LAZY_EVAL_MARGIN, so skip them (and the attack
+    // maps) when the estimate alone already decides the stand-pat.
+    Score base = 0;
+    int phase = 0, lazy = 0;
+    if (!cached) {
+        STAT_TIME(cyclesEval,
+            base = materialScore(b);
+            phase = computePhase(b);
+            lazy = taper(b, base, phase));
+
+        if (lazy - LAZY_EVAL_MARGIN >= beta) {
+            STAT_INC(standPatCutoffs);
+            STAT_INC(lazyCutoffs);
+            return beta;
+        }
+    }
+
+    AttackInfo ai;
+    STAT_TIME(cyclesMovegen, computeAttackInfo(b, &ai));
+
+    if (!cached) {
+        if (lazy + LAZY_EVAL_MARGIN <= alpha) {
+            stand_pat = lazy + LAZY_EVAL_MARGIN;
+        } else {
+            STAT_INC(evals);
+            STAT_TIME(cyclesEval, stand_pat = taper(b, base + positionalScore(b, &ai), phase));
+            evalCacheStore(b->key, stand_pat);
+        }
+    }
+
+    if (stand_pat >= beta) {
+        STAT_INC(standPatCutoffs);
         return beta;
+    }
 
     if (stand_pat > alpha)
         alpha = stand_pat;
@@ -277,16 +558,24 @@ int quiescence(Board *b, int alpha, int beta) {
     Move moves[256];
     uint64_t count = 0;
 
-    generateLegalMovesToArray(b, moves, &count, 256);
+    STAT_TIME(cyclesMovegen, generateLegalMovesWithAttacks(b, &ai, moves, &count, 256));
+    STAT_ADD(qMovesGenerated, count);
 
+    // keep captures only, best MVV-LVA first
+    uint64_t captures = 0;
     for (uint64_t i = 0; i < count; i++) {
-        if (!isCapture(b, moves[i]))
-            continue;
+        if (isCapture(b, moves[i]))
+            moves[captures++] = moves[i];
+    }
+    STAT_TIME(cyclesOrdering, orderMoves(b, moves, captures, 0, NULL));
 
+    for (uint64_t i = 0; i < captures; i++) {
+        STAT_INC(qCapturesSearched);
         Undo u;
         applyMove(b, moves[i], &u);
+        __builtin_prefetch(&evalCache[b->key & (EVAL_CACHE_SIZE - 1)]);
 
-        int score = -quiescence(b, -beta, -alpha);
+        int score = -quiescence(b, -beta, -alpha, ply + 1);
 
         unmakeMove(b, &u);
 
@@ -303,206 +592,669 @@ int quiescence(Board *b, int alpha, int beta) {
     return stand_pat;
 }
 int evaluate(Board *b) {
-    int mg = 0;   // middlegame score
-    int eg = 0;   // endgame score
-    U64 tmp;
-
-
-    /* ================= MATERIAL + PST ================= */
+    AttackInfo ai;
+    computeAttackInfo(b, &ai);
+    return evaluateWithAttacks(b, &ai);
+}
+int evaluateWithAttacks(Board *b, const AttackInfo *ai) {
+    Score score = materialScore(b) + positionalScore(b, ai);
+    return taper(b, score, computePhase(b));
+}
+// Mate scores are stored relative to the node, not the root.
+static inline int scoreToTT(int score, int ply) {
+    if (score >= TB_WIN_BOUND) return score + ply;
+    if (score <= -TB_WIN_BOUND) return score - ply;
+    return score;
+}
+static inline int scoreFromTT(int score, int ply) {
+    if (score >= TB_WIN_BOUND) return score - ply;
+    if (score <= -TB_WIN_BOUND) return score + ply;
+    return score;
+}
 
-    // White Pieces
+int search(Board *b, int depth) {
+    return minimax(b, depth, -INF_SCORE, INF_SCORE, 1);
+}
+static int minimaxNode(Board *board, int depth, int alpha, int beta, int ply) {
+    pvLength[ply] = ply;
+    if (shouldStop())
+        return 0;
+    nodesSearched++;
+    STAT_INC(nodes);
 
-    tmp = b->wp;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg += 100 + PST_PAWN[r][f];
-        eg += 100 + PST_PAWN_END[r][f];
-    }
+    /* ================= DRAWS ================= */
 
-    tmp = b->wn;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg += 300 + PST_KNIGHT[r][f];
-        eg += 300 + PST_KNIGHT_END[r][f];
+    if (isRepetition(board)) {
+        TRACE_SET(ply, result, TRACE_DRAW);
+        return 0;
     }
 
-    tmp = b->wb;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg += 300 + PST_BISHOP[r][f];
-        eg += 300 + PST_BISHOP_END[r][f];
+    if (alpha < 0 && hasUpcomingRepetition(board, ply)) {
+        alpha = 0;
+        if (alpha >= beta) {
+            TRACE_SET(ply, result, TRACE_DRAW);
+            return alpha;
+        }
     }
 
-    tmp = b->wr;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg += 500 + PST_ROOK[r][f];
-        eg += 500 + PST_ROOK_END[r][f];
+    if (depth == 0 || ply >= MAX_DEPTH) {
+        TRACE_SET(ply, result, TRACE_QSEARCH);
+        return quiescence(board, alpha, beta, ply);
     }
 
-    tmp = b->wq;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg += 900 + PST_QUEEN[r][f];
-        eg += 900 + PST_QUEEN_END[r][f];
+    /* ================= TRANSPOSITION TABLE ================= */
+
+    TTEntry tte;
+    Move ttMove = {0};
+    bool ttHit;
+    STAT_INC(ttProbes);
+    STAT_TIME(cyclesTT, ttHit = ttProbe(board->key, &tte));
+    if (ttHit) {
+        STAT_INC(ttHits);
+        ttMove = unpackMove(tte.move);
+        if (tte.depth >= depth) {
+            int ttScore = scoreFromTT(tte.score, ply);
+            int bound = tte.boundAge & 3;
+            if (bound == TT_LOWER && ttScore >= beta) {
+                STAT_INC(ttCutoffs);
+                TRACE_SET(ply, result, TRACE_TT_CUTOFF);
+                return beta;
+            }
+            if (bound == TT_UPPER && ttScore <= alpha) {
+                STAT_INC(ttCutoffs);
+                TRACE_SET(ply, result, TRACE_TT_CUTOFF);
+                return alpha;
+            }
+            if (bound == TT_EXACT) {
+                STAT_INC(ttCutoffs);
+                TRACE_SET(ply, result, TRACE_TT_CUTOFF);
+                return ttScore < alpha ? alpha : (ttScore > beta ? beta : ttScore);
+            }
+        }
     }
 
-    tmp = b->wk;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg += 20000 + PST_KING_MID[r][f];
-        eg += 20000 + PST_KING_END[r][f];
+    /* ================= TABLEBASES ================= */
+
+    // only right after a capture or pawn move, where WDL is exact under the
+    // 50-move rule; castling rights are not in the tables
+    int pieceCount = __builtin_popcountll(board->occupied);
+    if (pieceCount <= tbProbeLimit
+        && (pieceCount < tbProbeLimit || depth >= tbProbeDepth)
+        && board->halfmoveClock == 0
+        && !board->shortWhite && !board->longWhite
+        && !board->shortBlack && !board->longBlack) {
+        int success;
+        int wdl = tbProbeWDL(board, &success);
+        if (success) {
+            tbHits++;
+            int score = wdl < -1 ? -TB_WIN_SCORE + ply
+                      : wdl > 1 ? TB_WIN_SCORE - ply
+                      : 2 * wdl;
+            int bound = wdl < -1 ? TT_UPPER : (wdl > 1 ? TT_LOWER : TT_EXACT);
+
+            if (bound == TT_EXACT
+                || (bound == TT_LOWER ? score >= beta : score <= alpha)) {
+                Move none = {0};
+                ttStore(board->key, MAX_DEPTH - 1, scoreToTT(score, ply), bound, none);
+                TRACE_SET(ply, result, TRACE_TB_CUTOFF);
+                if (bound == TT_LOWER) return beta;
+                if (bound == TT_UPPER) return alpha;
+                return score < alpha ? alpha : (score > beta ? beta : score);
+            }
+        }
     }
 
+    AttackInfo ai;
+    Move moves[512];
+    uint64_t mcount = 0;
 
-// Black pieces
+    STAT_TIME(cyclesMovegen,
+        computeAttackInfo(board, &ai);
+        generateLegalMovesWithAttacks(board, &ai, moves, &mcount, 512));
 
-    tmp = b->bp;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg -= 100 + PST_PAWN[r][f];
-        eg -= 100 + PST_PAWN[r][f];
+    TRACE_SET(ply, moveCount, (uint8_t)(mcount > 255 ? 255 : mcount));
+    if (mcount == 0) {
+        TRACE_SET(ply, result, TRACE_MATE);
+        if (ai.checkers) {
+            return -MATE_SCORE + ply;
+        }
+        return 0;
     }
 
-    tmp = b->bn;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg -= 300 + PST_KNIGHT[r][f];
-        eg -= 300 + PST_KNIGHT[r][f];
+    if (board->halfmoveClock >= 100) {
+        TRACE_SET(ply, result, TRACE_DRAW);
+        return 0;
     }
 
-    tmp = b->bb;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg -= 300 + PST_BISHOP[r][f];
-        eg -= 300 + PST_BISHOP[r][f];
-    }
+    STAT_INC(expanded);
+    STAT_ADD(movesGenerated, mcount);
+    STAT_TIME(cyclesOrdering, orderMoves(board, moves, mcount, ply, &ttMove));
 
-    tmp = b->br;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg -= 500 + PST_ROOK[r][f];
-        eg -= 500 + PST_ROOK[r][f];
-    }
+    Move quietsTried[256];
+    int quietCount = 0;
+    int origAlpha = alpha;
+    Move bestMove = {0};
 
-    tmp = b->bq;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg -= 900 + PST_QUEEN[r][f];
-        eg -= 900 + PST_QUEEN[r][f];
-    }
+    for (uint64_t i = 0; i < mcount; i++) {
+        int isQuiet = !moves[i].promotionPiece && !(board->occupied & bit(moves[i].to));
 
-    tmp = b->bk;
-    while (tmp) {
-        int sq = pop_lsb(&tmp);
-        int r = sq >> 3, f = sq & 7;
-        mg -= 20000 + PST_KING_MID[r][f];
-        eg -= 20000 + PST_KING_END[r][f];
-    }
+        searchStack[ply].piece = pieceAt(board, moves[i].from);
+        searchStack[ply].to = moves[i].to;
 
+        STAT_INC(movesSearched);
+        TRACE_SET(ply + 1, move, packMove(moves[i]));
+        Undo u;
+        pushKeyHistory(board->key);
+        applyMove(board, moves[i], &u);
+        if (depth > 1) {
+            ttPrefetch(board->key);     // the child's first probe, after its draw checks
+        }
 
+        int score = -minimax(board, depth - 1,
+                             -beta, -alpha, ply + 1);
 
-    /* ================= PAWN STRUCTURE ================= */
+        unmakeMove(board, &u);
+        popKeyHistory();
 
-    int dp = doubledPawns(b, WHITE) - doubledPawns(b, BLACK);
-    int ip = isolatedPawns(b, WHITE) - isolatedPawns(b, BLACK);
-    int pp = passedPawns(b, WHITE) - passedPawns(b, BLACK);
+        if (searchStopped)
+            return 0;
 
-    mg -= DOUBLED_PAWN_BONUS * dp;
-    eg -= DOUBLED_PAWN_BONUS * dp;        // less severe in endgame
+        if (score >= beta) {
+            STAT_INC(failHighs);
+            if (i == 0) STAT_INC(failHighFirst);
+            TRACE_SET(ply, cutoffIndex, (uint8_t)(i > 254 ? 254 : i));
+            if (isQuiet) {
+                updateQuietStats(board, &moves[i], quietsTried, quietCount, ply, depth);
+            }
+            STAT_TIME(cyclesTT, ttStore(board->key, depth, scoreToTT(beta, ply), TT_LOWER, moves[i]));
+            return beta;
+        }
 
-    mg -= ISOLATED_PAWN_BONUS_MG * ip;
-    eg -= ISOLATED_PAWN_BONUS_EG * ip;
+        if (score > alpha) {
+            alpha = score;
+            bestMove = moves[i];
 
-    mg += PASSED_PAWN_BONUS_MG * pp;
-    eg += PASSED_PAWN_BONUS_EG * pp;        // VERY strong in endgame
+            pvTable[ply][ply] = moves[i];
+            for (int p = ply + 1; p < pvLength[ply + 1]; p++) {
+                pvTable[ply][p] = pvTable[ply + 1][p];
+            }
+            pvLength[ply] = pvLength[ply + 1];
+        }
 
+        if (isQuiet && quietCount < 256)
+            quietsTried[quietCount++] = moves[i];
+    }
 
-    /* ================= POSITIONAL ================= */
+    STAT_TIME(cyclesTT, ttStore(board->key, depth, scoreToTT(alpha, ply),
+                                alpha > origAlpha ? TT_EXACT : TT_UPPER, bestMove));
+    return alpha;
+}
+/*
+ * Without SEARCH_TRACE this is a plain call that the compiler folds into
+ * minimaxNode(); with it, the node is recorded on the way out.
+ */
+int minimax(Board *board, int depth, int alpha, int beta, int ply) {
+#ifdef SEARCH_TRACE
+    if (traceActive) {
+        uint64_t before = nodesSearched;
+        TraceNode *t = &traceNodes[ply];
+        t->result = TRACE_RESULT_COUNT;
+        t->cutoffIndex = 255;
+        t->moveCount = 0;
+
+        int score = minimaxNode(board, depth, alpha, beta, ply);
+
+        uint8_t result = t->result;
+        if (searchStopped)
+            result = TRACE_STOPPED;
+        else if (result == TRACE_RESULT_COUNT)
+            result = score >= beta ? TRACE_FAIL_HIGH : (score <= alpha ? TRACE_FAIL_LOW : TRACE_EXACT);
+
+        TraceRecord r = {
+            .alpha = alpha, .beta = beta, .score = score,
+            .nodes = (uint32_t)(nodesSearched - before),
+            .move = t->move, .ply = (uint8_t)ply, .depth = (int8_t)depth,
+            .result = result, .cutoffIndex = t->cutoffIndex, .moveCount = t->moveCount,
+        };
+        tracePush(&r);
+        return score;
+    }
+#endif
+    return minimaxNode(board, depth, alpha, beta, ply);
+}
 
-    mg += kingSafetyMG(b, WHITE);
-    mg -= kingSafetyMG(b, BLACK);
+/* ================= ROOT ================= */
+
+static _Thread_local bool searchSilent = false;
+static _Thread_local SearchInfoFn infoCallback = NULL;
+static _Thread_local void* infoCallbackData = NULL;
+
+// The report as a UCI "info" line with its newline; returns the length.
+int formatSearchInfo(const SearchInfo* info, char* out, size_t size) {
+    size_t n = 0;
+#define APPEND(...) (n += (size_t)snprintf(out + (n < size ? n : size), n < size ? size - n : 0, __VA_ARGS__))
+    APPEND("info depth %d seldepth %d multipv %d score ", info->depth, info->selDepth, info->multiPV);
+    if (info->score >= MATE_BOUND) {
+        APPEND("mate %d", (MATE_SCORE - info->score + 1) / 2);
+    } else if (info->score <= -MATE_BOUND) {
+        APPEND("mate %d", -(MATE_SCORE + info->score) / 2);
+    } else {
+        APPEND("cp %d", info->score);
+    }
+    APPEND(" nodes %llu", (unsigned long long)info->nodes);
+    if (info->timeMs >= 0) {        // the only wall-clock dependent output
+        APPEND(" nps %llu time %lld", (unsigned long long)info->nps, (long long)info->timeMs);
+    }
+    APPEND(" hashfull %d tbhits %llu pv", info->hashfull, (unsigned long long)info->tbHits);
+    for (int i = 0; i < info->pvLength; i++) {
+        char buf[6];
+        moveToString(info->pv[i], buf);
+        APPEND(" %s", buf);
+    }
+    APPEND("\n");
+#undef APPEND
+    return (int)n;
+}
+void printSearchInfo(const SearchInfo* info) {
+    char line[SEARCH_INFO_MAX];
+    formatSearchInfo(info, line, sizeof(line));
+    fputs(line, stdout);
+    fflush(stdout);
+}
+static void printInfo(int depth, int multiPV, int score, const Move *pv, int pvLen) {
+    if (searchSilent)
+        return;
+
+    SearchInfo info = {0};
+    info.depth = depth;
+    info.selDepth = selDepth;
+    info.multiPV = multiPV;
+    info.score = score;
+    info.nodes = nodesSearched;
+    info.timeMs = -1;
+    if (!searchDeterministic) {
+        double elapsed = nowSeconds() - searchStart;
+        info.timeMs = (int64_t)(elapsed * 1000.0);
+        info.nps = elapsed > 0.0 ? (uint64_t)(nodesSearched / elapsed) : 0;
+    }
+    info.hashfull = ttHashfull();
+    info.tbHits = tbHits;
+    info.pv = pv;
+    info.pvLength = pvLen;
 
-    /* ================= MOBILITY ================= */
+    if (infoCallback) {
+        infoCallback(&info, infoCallbackData);
+    } else {
+        printSearchInfo(&info);
+    }
+}
+// TT cutoffs inside the tree leave the triangular PV short; continue it
+// with the stored best moves as long as they are legal.
+static int extendPvFromTT(Board *board, Move *pv, int pvLen, int maxLen) {
+    Undo undos[MAX_DEPTH + 1];
+    int played = 0;
+
+    for (; played < pvLen; played++) {
+        applyMove(board, pv[played], &undos[played]);
+    }
 
-    mg += knightMobility(b, WHITE) * 2;
-    mg += bishopMobility(b, WHITE) * 2;
+    while (pvLen < maxLen) {
+        TTEntry tte;
+        if (!ttProbe(board->key, &tte) || !tte.move)
+            break;
+
+        Move m = unpackMove(tte.move);
+        Move legal[256];
+        uint64_t count = 0;
+        generateLegalMovesToArray(board, legal, &count, 256);
+
+        bool found = false;
+        for (uint64_t i = 0; i < count; i++) {
+            if (sameMove(&legal[i], &m)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            break;
 
-    mg -= knightMobility(b, BLACK) * 2;
-    mg -= bishopMobility(b, BLACK) * 2;
+        pv[pvLen++] = m;
+        applyMove(board, m, &undos[played++]);
+    }
 
-    eg += knightMobility(b, WHITE);
-    eg -= knightMobility(b, BLACK);
+    while (played > 0) {
+        unmakeMove(board, &undos[--played]);
+    }
+    return pvLen;
+}
+// Best move first, the rest by how much effort they took last iteration.
+static void sortRootMoves(RootMove *rootMoves, int count, int bestIndex) {
+    RootMove best = rootMoves[bestIndex];
+    for (int i = bestIndex; i > 0; i--) {
+        rootMoves[i] = rootMoves[i - 1];
+    }
+    rootMoves[0] = best;
+
+    for (int i = 2; i < count; i++) {
+        RootMove rm = rootMoves[i];
+        int j = i - 1;
+        while (j >= 1 && rootMoves[j].nodes < rm.nodes) {
+            rootMoves[j + 1] = rootMoves[j];
+            j--;
+        }
+        rootMoves[j + 1] = rm;
+    }
+}
+// The finished MultiPV lines by score, best first; equal scores keep their order.
+static void sortLinesByScore(RootMove *rootMoves, int count) {
+    for (int i = 1; i < count; i++) {
+        RootMove rm = rootMoves[i];
+        int j = i - 1;
+        while (j >= 0 && rootMoves[j].score < rm.score) {
+            rootMoves[j + 1] = rootMoves[j];
+            j--;
+        }
+        rootMoves[j + 1] = rm;
+    }
+}
+/*
+ * One pass over the root moves with a shared window: alpha rises as root
+ * moves are resolved, so later moves are searched against the best score
+ * so far. Returns the index of the best move, or -1 if the search was
+ * stopped before any move completed.
+ */
+static int searchRoot(Board *board, RootMove *moves, int count, int depth) {
+    int alpha = -INF_SCORE;
+    int beta = INF_SCORE;
+    int bestIndex = -1;
+
+    for (int i = 0; i < count; i++) {
+        Move m = moves[i].move;
+        uint64_t before = nodesSearched;
+
+        searchStack[0].piece = pieceAt(board, m.from);
+        searchStack[0].to = m.to;
+
+        TRACE_SET(1, move, packMove(m));
+        Undo u;
+        pushKeyHistory(board->key);
+        applyMove(board, m, &u);
+        int score = -minimax(board, depth - 1, -beta, -alpha, 1);
+        unmakeMove(board, &u);
+        popKeyHistory();
 
+        moves[i].nodes = nodesSearched - before;
 
-    /* ================= PHASE ================= */
+        if (searchStopped)
+            break;
 
-    int phase = computePhase(b);
-    int s = (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+        if (score > alpha) {
+            alpha = score;
+            bestIndex = i;
+            moves[i].score = score;
 
-    return b->mover == WHITE ? s : -s;
+            moves[i].pv[0] = m;
+            for (int p = 1; p < pvLength[1]; p++) {
+                moves[i].pv[p] = pvTable[1][p];
+            }
+            moves[i].pvLength = pvLength[1] > 1 ? pvLength[1] : 1;
+        } else {
+            moves[i].score = -INF_SCORE;
+        }
+    }
 
+    return bestIndex;
 }
-int search(Board *b, int depth) {
-    memset(historyTable, 0, sizeof(historyTable));
-    memset(killerMoves, 0, sizeof(killerMoves));
+/*
+ * Simple clock allocation: a share of the remaining time plus most of the
+ * increment, counted from start (the search start, or the ponderhit). A
+ * deterministic search turns the budget into node limits at
+ * DETERMINISTIC_NODES_PER_MS so that it never reads the clock.
+ */
+static void setupDeadlines(const SearchLimits *limits, double start, uint64_t startNodes) {
+    softDeadline = 0.0;
+    hardDeadline = 0.0;
+    nodeLimit = limits->nodes ? startNodes + limits->nodes : 0;
+    softNodeLimit = 0;
+
+    int64_t softMs = 0, hardMs = 0;
+    if (limits->moveTimeMs > 0) {
+        hardMs = softMs = limits->moveTimeMs;
+    } else if (limits->timeLeftMs > 0) {
+        int movesToGo = limits->movesToGo > 0 ? limits->movesToGo : 30;
+        int64_t budget = limits->timeLeftMs / movesToGo + limits->incrementMs * 3 / 4;
+        int64_t maxBudget = limits->timeLeftMs - 50;
+        if (budget > maxBudget) budget = maxBudget;
+        if (budget < 10) budget = 10;
+
+        softMs = budget / 2;
+        hardMs = budget;
+    }
+    if (!hardMs)
+        return;
 
-    return minimax(b, depth, -10000000, 10000000, 1);
+    if (limits->deterministic) {
+        uint64_t hardNodes = startNodes + (uint64_t)hardMs * DETERMINISTIC_NODES_PER_MS;
+        if (!nodeLimit || hardNodes < nodeLimit) nodeLimit = hardNodes;
+        softNodeLimit = startNodes + (uint64_t)softMs * DETERMINISTIC_NODES_PER_MS;
+    } else {
+        softDeadline = start + softMs / 1000.0;
+        hardDeadline = start + hardMs / 1000.0;
+    }
 }
-int minimax(Board *board, int depth, int alpha, int beta, int ply) {
-    if (depth == 0) {
-        return quiescence(board, alpha, beta);
+// The reply the PV expects, for "bestmove ... ponder".
+static Move ponderMove(const RootMove *rm) {
+    Move none = { -1, -1, 0, 0 };
+    return rm->pvLength > 1 ? rm->pv[1] : none;
+}
+// No bestmove while pondering or in an infinite search until released.
+static void waitForRelease(const SearchLimits *limits) {
+    const struct timespec tick = { 0, 1000000 };
+    for (;;) {
+        checkPonderhit();
+        if (!searchPondering && !limits->infinite)
+            return;
+        if (stopSignal && __atomic_load_n(stopSignal, __ATOMIC_RELAXED))
+            return;
+        if (!stopSignal && !ponderhitSignal)
+            return;             // nothing could ever release it
+        nanosleep(&tick, NULL);
+    }
+}
+/*
+ * Iterative deepening. With MultiPV = K each iteration runs K root passes:
+ * pass k searches the root moves not yet chosen, and its winner becomes
+ * line k. All passes share the TT and the ordering tables.
+ */
+Move findBestMove(Board* board, const SearchLimits* limits, SearchResult* result) {
+    nodesSearched = 0;
+    tbHits = 0;
+    searchStopped = false;
+    selDepth = 0;
+    searchStart = nowSeconds();
+    searchSilent = limits->silent;
+    searchDeterministic = limits->deterministic;
+    infoCallback = limits->onInfo;
+    infoCallbackData = limits->infoData;
+    stopSignal = limits->stop;
+    ponderhitSignal = limits->ponderhit;
+    searchLimits = limits;
+    searchPondering = limits->ponder;
+    if (searchPondering) {
+        softDeadline = hardDeadline = 0.0;
+        nodeLimit = softNodeLimit = 0;
+    } else {
+        setupDeadlines(limits, searchStart, 0);
+    }
+    statsReset();
+#ifdef SEARCH_TRACE
+    traceBeginSearch(limits->silent);
+#endif
+#ifdef SEARCH_STATS
+    uint64_t searchCycles = statsClock();
+#endif
+
+    if (result) {
+        memset(result, 0, sizeof(*result));
+        result->ponder.from = result->ponder.to = -1;
     }
 
-    Move moves[512];
-    uint64_t mcount = 0;
+    // A deterministic search starts from the state of a fresh process, so
+    // its result depends only on the position, the limits and the options.
+    if (limits->deterministic) {
+        clearHeuristics();
+        ttClear();
+        evalCacheClear();
+    } else {
+        ageHeuristics();
+    }
+    ttNewSearch();
+    if (evalCacheGeneration != evalGeneration) {
+        evalCacheClear();
+    }
 
-    generateLegalMovesToArray(board, moves, &mcount, 512);
+    Move legalMoves[256];
+    uint64_t moveCount = 0;
 
-    if (mcount == 0) {
-        if (inCheck_bit(board, board->mover)) {
-            return -100000 - depth;
+    generateLegalMovesToArray(board, legalMoves, &moveCount, 256);
+
+    if (moveCount == 0) {
+        Move nullMove = { -1, -1, 0, 0 };
+        waitForRelease(limits);
+        return nullMove;
+    }
+
+    // pondering and analysis search even in the book; a deterministic
+    // search takes the top-weighted move instead of a random one
+    Move bookMove;
+    if (!limits->ponder && !limits->infinite && bookProbe(board, limits->deterministic, &bookMove)) {
+        if (!searchSilent && infoCallback) {
+            SearchInfo info = {0};
+            info.multiPV = 1;
+            info.timeMs = -1;
+            info.pv = &bookMove;
+            info.pvLength = 1;
+            infoCallback(&info, infoCallbackData);
+        } else if (!searchSilent) {
+            char buf[6];
+            moveToString(bookMove, buf);
+            printf("info string book move %s\n", buf);
+            fflush(stdout);
         }
-        return 0;
+        return bookMove;
     }
 
-    orderMoves(board, moves, mcount, depth);
+    orderMoves(board, legalMoves, moveCount, 0, NULL);
+
+    // With the root in the tablebases keep only the moves that preserve the
+    // best result. DTZ ranking already guarantees progress, so the search
+    // then runs without probes; a WDL-only ranking keeps probing while winning.
+    tbProbeLimit = tbLargest;
+    int ranks[256];
+    bool usedDTZ;
+    if (tbRankRootMoves(board, legalMoves, (int)moveCount, ranks, &usedDTZ)) {
+        int bestRank = ranks[0];
+        for (uint64_t i = 1; i < moveCount; i++) {
+            if (ranks[i] > bestRank) bestRank = ranks[i];
+        }
+        uint64_t kept = 0;
+        for (uint64_t i = 0; i < moveCount; i++) {
+            if (ranks[i] == bestRank) legalMoves[kept++] = legalMoves[i];
+        }
+        moveCount = kept;
+        tbHits += kept;
+        if (usedDTZ || bestRank <= 0) tbProbeLimit = 0;
+    }
 
-    for (uint64_t i = 0; i < mcount; i++) {
-        int isCapture = (getCapturedPiece(board, moves[i].to) != -1);
+    for (uint64_t i = 0; i < moveCount; i++) {
+        rootMoves[i].move = legalMoves[i];
+        rootMoves[i].score = -INF_SCORE;
+        rootMoves[i].nodes = 0;
+        rootMoves[i].pv[0] = legalMoves[i];
+        rootMoves[i].pvLength = 1;
+    }
 
-        Undo u;
-        applyMove(board, moves[i], &u);
+    int count = (int)moveCount;
+    int multiPV = limits->multiPV > 0 ? limits->multiPV : 1;
+    if (multiPV > count) multiPV = count;
 
-        int score = -minimax(board, depth - 1,
-                             -beta, -alpha, ply + 1);
+    int maxDepth = limits->depth > 0 ? limits->depth : MAX_DEPTH - 1;
+    if (maxDepth > MAX_DEPTH - 1) maxDepth = MAX_DEPTH - 1;
 
-        unmakeMove(board, &u);
+    int completedDepth = 0;
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        int linesDone = 0;
 
-        if (score >= beta) {
-            if (!isCapture) {
-                historyTable[moves[i].from][moves[i].to] += depth * depth;
+        for (int pvIdx = 0; pvIdx < multiPV; pvIdx++) {
+            int bestIndex = searchRoot(board, rootMoves + pvIdx, count - pvIdx, depth);
 
-                killerMoves[1][ply] = killerMoves[0][ply];
-                killerMoves[0][ply] = moves[i];
+            // a move that completed and beat the first one is usable even if
+            // the pass was cut short
+            if (bestIndex >= 0) {
+                sortRootMoves(rootMoves + pvIdx, count - pvIdx, bestIndex);
+                if (pvIdx == 0) {
+                    ttStore(board->key, depth, scoreToTT(rootMoves[0].score, 0),
+                            TT_EXACT, rootMoves[0].move);
+                }
+            }
+            if (searchStopped)
+                break;
+            linesDone++;
+        }
+        if (searchStopped && linesDone == 0)
+            break;
+
+        // a later line can come back above an earlier one (it was searched
+        // with a warmer TT), so rank them before reporting and picking bestmove
+        if (linesDone > 1) {
+            Move first = rootMoves[0].move;
+            sortLinesByScore(rootMoves, linesDone);
+            if (!sameMove(&rootMoves[0].move, &first)) {
+                ttStore(board->key, depth, scoreToTT(rootMoves[0].score, 0),
+                        TT_EXACT, rootMoves[0].move);
             }
-            return beta;
         }
 
-        if (score > alpha)
-            alpha = score;
+        for (int k = 0; k < linesDone; k++) {
+            RootMove *rm = &rootMoves[k];
+            rm->pvLength = extendPvFromTT(board, rm->pv, rm->pvLength, depth);
+            printInfo(depth, k + 1, rm->score, rm->pv, rm->pvLength);
+        }
+        if (linesDone == multiPV) {
+            completedDepth = depth;
+#ifdef SEARCH_STATS
+            searchStats.iterationNodes[0] = searchStats.iterationNodes[1];
+            searchStats.iterationNodes[1] = nodesSearched;
+#endif
+        }
+
+        if (searchStopped)
+            break;
+        checkPonderhit();
+        if (softDeadline > 0.0 && nowSeconds() >= softDeadline)
+            break;
+        if (softNodeLimit && nodesSearched >= softNodeLimit)
+            break;
     }
 
-    return alpha;
+    if (!searchStopped) {
+        waitForRelease(limits);
+    }
+
+#ifdef SEARCH_STATS
+    searchStats.cyclesSearch = statsClock() - searchCycles;
+    if (!searchSilent) {
+        statsPrint();
+    }
+#endif
+
+    if (result) {
+        result->score = rootMoves[0].score;
+        result->depth = completedDepth;
+        result->selDepth = selDepth;
+        result->nodes = nodesSearched;
+        result->timeMs = searchDeterministic ? 0 : (int64_t)((nowSeconds() - searchStart) * 1000.0);
+        result->ponder = ponderMove(&rootMoves[0]);
+    }
+    return rootMoves[0].move;
 }
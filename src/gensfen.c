@@ -0,0 +1,340 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gensfen.h"
+
+// ----------------- Packed positions -----------------
+
+void packPosition(const Board* b, int score, int ply, int result, PackedPos* out) {
+    memset(out, 0, sizeof(*out));
+    out->occupied = b->occupied;
+
+    U64 occ = b->occupied;
+    for (int n = 0; occ; n++) {
+        int sq = pop_lsb(&occ);
+        out->pieces[n >> 1] |= (uint8_t)(pieceAt(b, sq) << ((n & 1) * 4));
+    }
+
+    if (score > 32000) score = 32000;
+    if (score < -32000) score = -32000;
+    out->score = (int16_t)score;
+    out->ply = (uint16_t)(ply < 65535 ? ply : 65535);
+    out->result = (int8_t)result;
+    out->flags = (uint8_t)((b->mover == BLACK) | (b->shortWhite << 1) | (b->longWhite << 2)
+                           | (b->shortBlack << 3) | (b->longBlack << 4));
+    out->epSquare = (uint8_t)(b->enPassantSquare >= 0 ? b->enPassantSquare : 64);
+    out->halfmove = (uint8_t)(b->halfmoveClock < 255 ? b->halfmoveClock : 255);
+}
+
+void unpackPosition(const PackedPos* p, Board* b) {
+    memset(b, 0, sizeof(*b));
+
+    U64 occ = p->occupied;
+    for (int n = 0; occ; n++) {
+        int sq = pop_lsb(&occ);
+        setPiece(b, sq, (p->pieces[n >> 1] >> ((n & 1) * 4)) & 15);
+    }
+
+    b->mover = (p->flags & 1) ? BLACK : WHITE;
+    b->shortWhite = (p->flags >> 1) & 1;
+    b->longWhite  = (p->flags >> 2) & 1;
+    b->shortBlack = (p->flags >> 3) & 1;
+    b->longBlack  = (p->flags >> 4) & 1;
+    b->enPassantSquare = p->epSquare < 64 ? p->epSquare : -1;
+    b->halfmoveClock = p->halfmove;
+
+    updateOccupancies(b);
+    b->key = computeKey(b);
+}
+
+// ----------------- Self-play generator -----------------
+
+/*
+ * chess gensfen out FILE [count N] [nodes N] [threads N] [randomply N]
+ *               [evallimit CP] [dedup MB] [seed S]
+ *
+ * Every thread plays its own games: a few uniformly random opening plies,
+ * then fixed-node searches for both sides until mate, a draw, or a score
+ * beyond evallimit (adjudicated to the side ahead). Quiet positions (not
+ * in check, best move neither a capture nor a promotion) are kept, their
+ * results filled in once the game is over, and appended to FILE.
+ *
+ * Duplicates are dropped through a lossy table of Zobrist keys shared by
+ * all threads: a position is written only if its key is not already in
+ * its slot.
+ */
+
+#define GENSFEN_MAX_PLY 400
+
+typedef struct {
+    FILE* out;
+    uint64_t target;
+    uint64_t nodes;
+    int randomPly;
+    int evalLimit;
+
+    U64* seen;                  // dedup slots, indexed by key & seenMask
+    U64 seenMask;
+
+    pthread_mutex_t outLock;
+    uint64_t written;
+    uint64_t games;
+    uint64_t duplicates;
+    double start;
+} GensfenJob;
+
+typedef struct {
+    GensfenJob* job;
+    U64 rng;
+} GensfenWorker;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline U64 nextRandom(U64* state) {
+    U64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static bool alreadySeen(GensfenJob* job, U64 key) {
+    if (!job->seen)
+        return false;
+    return __atomic_exchange_n(&job->seen[key & job->seenMask], key, __ATOMIC_RELAXED) == key;
+}
+
+static void playMove(Board* b, Move m) {
+    Undo u;
+    pushKeyHistory(b->key);
+    applyMove(b, m, &u);
+}
+
+// Plays one game into recs; returns the number of records kept.
+static int playGame(GensfenWorker* w, PackedPos* recs) {
+    GensfenJob* job = w->job;
+    Board b;
+    boardSetup(&b);
+    resetKeyHistory();
+
+    // an odd number of random plies now and then, so both colors start
+    int ply = 0;
+    int randomPly = job->randomPly + (int)(nextRandom(&w->rng) & 1);
+    for (; ply < randomPly; ply++) {
+        Move legal[256];
+        uint64_t count = 0;
+        generateLegalMovesToArray(&b, legal, &count, 256);
+        if (count == 0)
+            return 0;
+        playMove(&b, legal[nextRandom(&w->rng) % count]);
+    }
+
+    SearchLimits limits;
+    memset(&limits, 0, sizeof(limits));
+    limits.nodes = job->nodes;
+    limits.multiPV = 1;
+    limits.silent = true;
+
+    int kept = 0;
+    int whiteResult = 0;
+    uint8_t movers[GENSFEN_MAX_PLY];
+
+    for (; ply < GENSFEN_MAX_PLY; ply++) {
+        AttackInfo ai;
+        Move legal[256];
+        uint64_t count = 0;
+        computeAttackInfo(&b, &ai);
+        generateLegalMovesWithAttacks(&b, &ai, legal, &count, 256);
+
+        if (count == 0) {
+            if (ai.checkers)
+                whiteResult = b.mover == WHITE ? -1 : 1;
+            break;
+        }
+        if (b.halfmoveClock >= 100 || isRepetition(&b) || b.occupied == (b.wk | b.bk))
+            break;
+
+        SearchResult res;
+        Move best = findBestMove(&b, &limits, &res);
+        if (res.score >= job->evalLimit || res.score <= -job->evalLimit) {
+            whiteResult = (res.score > 0) == (b.mover == WHITE) ? 1 : -1;
+            break;
+        }
+
+        bool tactical = (b.occupied & bit(best.to)) || best.promotionPiece
+                        || ((pieceAt(&b, best.from) & 7) == PAWN && best.to == b.enPassantSquare);
+        if (!ai.checkers && !tactical && !alreadySeen(job, b.key)) {
+            packPosition(&b, res.score, ply, 0, &recs[kept]);
+            movers[kept++] = (uint8_t)b.mover;
+        }
+        playMove(&b, best);
+    }
+
+    for (int i = 0; i < kept; i++) {
+        recs[i].result = (int8_t)(movers[i] == WHITE ? whiteResult : -whiteResult);
+    }
+    return kept;
+}
+
+static void* gensfenWorker(void* arg) {
+    GensfenWorker* w = (GensfenWorker*)arg;
+    GensfenJob* job = w->job;
+    PackedPos recs[GENSFEN_MAX_PLY];
+
+    clearHeuristics();
+    while (__atomic_load_n(&job->written, __ATOMIC_RELAXED) < job->target) {
+        int n = playGame(w, recs);
+
+        pthread_mutex_lock(&job->outLock);
+        uint64_t room = job->target > job->written ? job->target - job->written : 0;
+        if ((uint64_t)n > room) n = (int)room;
+        fwrite(recs, sizeof(PackedPos), (size_t)n, job->out);
+        uint64_t before = job->written;
+        __atomic_store_n(&job->written, before + (uint64_t)n, __ATOMIC_RELAXED);
+        job->games++;
+        if (before / 100000 != job->written / 100000) {
+            double elapsed = nowSeconds() - job->start;
+            fprintf(stderr, "%llu positions, %llu games, %.0f pos/s\n",
+                    (unsigned long long)job->written, (unsigned long long)job->games,
+                    elapsed > 0 ? job->written / elapsed : 0.0);
+        }
+        pthread_mutex_unlock(&job->outLock);
+    }
+    return NULL;
+}
+
+int runGensfen(int argc, char** argv) {
+    GensfenJob job;
+    memset(&job, 0, sizeof(job));
+    job.target = 1000000;
+    job.nodes = 5000;
+    job.randomPly = 8;
+    job.evalLimit = 3000;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    size_t dedupMB = 64;
+    U64 seed = (U64)time(NULL);
+    const char* outPath = NULL;
+
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "out"))             outPath = argv[i + 1];
+        else if (!strcmp(argv[i], "count"))      job.target = strtoull(argv[i + 1], NULL, 10);
+        else if (!strcmp(argv[i], "nodes"))      job.nodes = strtoull(argv[i + 1], NULL, 10);
+        else if (!strcmp(argv[i], "threads"))    threads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "randomply"))  job.randomPly = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "evallimit"))  job.evalLimit = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "dedup"))      dedupMB = (size_t)atol(argv[i + 1]);
+        else if (!strcmp(argv[i], "seed"))       seed = strtoull(argv[i + 1], NULL, 10);
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!outPath) {
+        fprintf(stderr, "usage: chess gensfen out FILE [count N] [nodes N] [threads N] "
+                        "[randomply N] [evallimit CP] [dedup MB] [seed S]\n");
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+
+    job.out = fopen(outPath, "ab");
+    if (!job.out) {
+        fprintf(stderr, "cannot open %s\n", outPath);
+        return 1;
+    }
+
+    if (dedupMB) {
+        size_t slots = 1;
+        while (slots * 2 * sizeof(U64) <= dedupMB << 20) slots *= 2;
+        job.seen = (U64*) calloc(slots, sizeof(U64));
+        job.seenMask = job.seen ? slots - 1 : 0;
+    }
+
+    pthread_mutex_init(&job.outLock, NULL);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 32u << 20);
+
+    GensfenWorker* workers = (GensfenWorker*) calloc((size_t)threads, sizeof(GensfenWorker));
+    pthread_t* tids = (pthread_t*) calloc((size_t)threads, sizeof(pthread_t));
+    job.start = nowSeconds();
+
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        workers[i].job = &job;
+        workers[i].rng = (seed + (U64)i + 1) * 0x9E3779B97F4A7C15ULL | 1;
+        if (pthread_create(&tids[i], &attr, gensfenWorker, &workers[i]) != 0)
+            break;
+        started++;
+    }
+    if (started == 0)
+        gensfenWorker(&workers[0]);
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    double elapsed = nowSeconds() - job.start;
+    fprintf(stderr, "%llu positions from %llu games in %.1fs (%.0f pos/s) -> %s\n",
+            (unsigned long long)job.written, (unsigned long long)job.games, elapsed,
+            elapsed > 0 ? job.written / elapsed : 0.0, outPath);
+
+    fclose(job.out);
+    pthread_attr_destroy(&attr);
+    pthread_mutex_destroy(&job.outLock);
+    free(workers);
+    free(tids);
+    free(job.seen);
+    return 0;
+}
+
+// ----------------- Reading data files -----------------
+
+// chess sfendump <file> [count]: record count and the first records as FEN.
+int runSfenDump(int argc, char** argv) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: chess sfendump <file> [count]\n");
+        return 1;
+    }
+    int fd = open(argv[0], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || st.st_size < (off_t)sizeof(PackedPos)) {
+        fprintf(stderr, "cannot read %s\n", argv[0]);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "cannot map %s\n", argv[0]);
+        return 1;
+    }
+
+    const PackedPos* recs = (const PackedPos*)data;
+    size_t total = (size_t)st.st_size / sizeof(PackedPos);
+    size_t show = argc > 1 ? (size_t)atol(argv[1]) : 10;
+    if (show > total) show = total;
+
+    printf("%zu records\n", total);
+    for (size_t i = 0; i < show; i++) {
+        Board b;
+        char fen[FEN_MAX];
+        unpackPosition(&recs[i], &b);
+        boardToFEN(&b, fen);
+        printf("%s | score %d ply %u result %d\n", fen, recs[i].score, recs[i].ply, recs[i].result);
+    }
+
+    munmap(data, (size_t)st.st_size);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef GENSFEN_H
+#define GENSFEN_H
+
+#include "bitboard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Training position record: 32 bytes, little-endian, written back to back
+ * with no file header, so a data file can be mmap'd as a PackedPos array
+ * (record count = file size / 32).
+ *
+ *   occupied   occupancy bitboard, a1 = bit 0
+ *   pieces     4-bit piece codes (type | color, as in Board) of the set bits
+ *              of occupied in ascending square order, low nibble first
+ *   score      search score in centipawns, from the side to move
+ *   ply        game ply of the position
+ *   result     game result from the side to move: 1 win, 0 draw, -1 loss
+ *   flags      bit 0 black to move, bits 1-4 castling rights K Q k q
+ *   epSquare   en passant square, 64 if none
+ *   halfmove   halfmove clock, capped at 255
+ */
+typedef struct {
+    uint64_t occupied;
+    uint8_t pieces[16];
+    int16_t score;
+    uint16_t ply;
+    int8_t result;
+    uint8_t flags;
+    uint8_t epSquare;
+    uint8_t halfmove;
+} PackedPos;
+
+_Static_assert(sizeof(PackedPos) == 32, "PackedPos must stay 32 bytes");
+
+void packPosition(const Board* b, int score, int ply, int result, PackedPos* out);
+void unpackPosition(const PackedPos* p, Board* b);
+
+/* "chess gensfen ..." and "chess sfendump <file> [count]" */
+int runGensfen(int argc, char** argv);
+int runSfenDump(int argc, char** argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENSFEN_H */
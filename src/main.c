@@ -1,114 +1,346 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "bitboard.h"
-Move findBestMove(Board* board, int depth) {
-    Move legalMoves[512];
-    uint64_t moveCount = 0;
+#include "syzygy.h"
+#include "pgn.h"
+#include "gensfen.h"
+#include "trace.h"
+#include "engine.h"
 
-    generateLegalMovesToArray(board, legalMoves, &moveCount, 512);
+#define BENCH_DEPTH 4
+#define MAX_MULTIPV 256
 
-    if (moveCount == 0) {
-        Move nullMove = {0};
-        return nullMove;
-    }
+static int multiPVOption = 1;
+static bool deterministicOption = false;
 
-    Move bestMove = legalMoves[0];
-    int bestScore = INT_MIN;
+static const char* benchPositions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "r2q1rk1/ppp2ppp/2np1n2/2b1p1B1/2B1P1b1/2NP1N2/PPP2PPP/R2Q1RK1 w - - 0 8",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "8/5pk1/6p1/8/8/3Q4/5PPP/6K1 w - - 0 1",
+    "2r3k1/pp3ppp/4p3/3pP3/3P4/P1R2N2/1P3PPP/6K1 b - - 0 25",
+};
 
-    for (uint64_t i = 0; i < moveCount; i++) {
-        Undo u;
-        Move currentMove = legalMoves[i];
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-        applyMove(board, currentMove, &u);
-        int score = -search(board, depth-1);
-        unmakeMove(board, &u);
+// Fixed-depth search over benchPositions; the node total is the signature
+// used to compare move ordering and search changes between builds. Every
+// position is searched deterministically, from cleared tables.
+static void runBench(int depth) {
+    const int count = (int)(sizeof(benchPositions) / sizeof(benchPositions[0]));
+    uint64_t totalNodes = 0;
+    double start = nowSeconds();
 
-        if (score > bestScore) {
-            bestScore = score;
-            bestMove = currentMove;
-        }
+    clearHeuristics();
+    for (int i = 0; i < count; i++) {
+        Board board;
+        parseFEN(&board, benchPositions[i]);
+        resetKeyHistory();
+
+        SearchLimits limits = {0};
+        limits.depth = depth;
+        limits.deterministic = true;
+        Move best = findBestMove(&board, &limits, NULL);
+        totalNodes += nodesSearched;
+
+        char moveStr[6];
+        moveToString(best, moveStr);
+        printf("Position %2d/%d: %10llu nodes  bestmove %s\n", i + 1, count,
+               (unsigned long long)nodesSearched, moveStr);
     }
 
-    return bestMove;
+    double elapsed = nowSeconds() - start;
+    printf("\n===========================\n");
+    printf("Total time (ms) : %.0f\n", elapsed * 1000.0);
+    printf("Nodes searched  : %llu\n", (unsigned long long)totalNodes);
+    printf("Nodes/second    : %.0f\n", elapsed > 0 ? totalNodes / elapsed : 0.0);
+    fflush(stdout);
+}
+// UCI output for engineSearch(); depth 0 is a book move
+static void uciInfo(const SearchInfo* info, void* data) {
+    (void)data;
+    if (info->depth == 0) {
+        char buf[6];
+        moveToString(info->pv[0], buf);
+        printf("info string book move %s\n", buf);
+        fflush(stdout);
+        return;
+    }
+    printSearchInfo(info);
+}
+// "stats" and "evalcache" read the per-thread state of the engine's thread
+static void printStatsJob(void* arg) {
+    (void)arg;
+    statsPrint();
+}
+static void evalCacheJob(void* arg) {
+    if (arg) {
+        evalCacheClear();
+    }
+    EvalCacheStats st;
+    evalCacheGetStats(&st);
+    printf("info string evalcache entries %zu (%zu KB) used %zu (%.1f%%) probes %llu hits %llu (%.1f%%) stores %llu\n",
+           st.entries, st.entries * sizeof(uint64_t) / 1024, st.used, 100.0 * st.used / st.entries,
+           (unsigned long long)st.probes, (unsigned long long)st.hits,
+           st.probes ? 100.0 * st.hits / st.probes : 0.0, (unsigned long long)st.stores);
+    fflush(stdout);
 }
 
+// ----------------- Search thread -----------------
 
-void applyUciMove(Board* board, const char* moveStr) {
-    Move m;
-    memset(&m, 0, sizeof(m));
-    int fromFile = moveStr[0] - 'a';
-    int fromRank = moveStr[1] - '1';
-    int toFile   = moveStr[2] - 'a';
-    int toRank   = moveStr[3] - '1';
+// "go" searches on a thread of its own so that stop, ponderhit and isready
+// are still read while it runs; every other command waits for it first.
+typedef struct {
+    EngineContext* engine;
+    SearchLimits limits;
+} GoJob;
 
-    m.from = fromRank * 8 + fromFile;
-    m.to   = toRank   * 8 + toFile;
+static GoJob goJob;
+static pthread_t searchThread;
+static bool searching = false;
+static bool stopFlag = false;           // SearchLimits.stop / .ponderhit of every search
+static bool ponderhitFlag = false;
 
-    m.promotionPiece = 0;
+static void* searchThreadMain(void* arg) {
+    GoJob* job = (GoJob*) arg;
+    SearchResult result;
+    Move bestMove = engineSearch(job->engine, &job->limits, uciInfo, NULL, &result);
 
-    if ((int)strlen(moveStr) >= 5) {
-        switch(moveStr[4]) {
-            case 'q': case 'Q': m.promotionPiece = QUEEN; break;
-            case 'r': case 'R': m.promotionPiece = ROOK;  break;
-            case 'b': case 'B': m.promotionPiece = BISHOP;break;
-            case 'n': case 'N': m.promotionPiece = KNIGHT;break;
-        }
+    if (bestMove.from < 0 || bestMove.from > 63) {
+        printf("bestmove 0000\n");
+    } else if (result.ponder.from >= 0) {
+        char moveStr[6], ponderStr[6];
+        moveToString(bestMove, moveStr);
+        moveToString(result.ponder, ponderStr);
+        printf("bestmove %s ponder %s\n", moveStr, ponderStr);
+    } else {
+        char moveStr[6];
+        moveToString(bestMove, moveStr);
+        printf("bestmove %s\n", moveStr);
+    }
+    fflush(stdout);
+    return NULL;
+}
+static void startSearch(EngineContext* engine, const SearchLimits* limits) {
+    goJob.engine = engine;
+    goJob.limits = *limits;
+    goJob.limits.stop = &stopFlag;
+    goJob.limits.ponderhit = &ponderhitFlag;
+    __atomic_store_n(&stopFlag, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&ponderhitFlag, false, __ATOMIC_RELAXED);
+    if (pthread_create(&searchThread, NULL, searchThreadMain, &goJob) != 0) {
+        searchThreadMain(&goJob);
+        return;
+    }
+    searching = true;
+}
+static void stopSearch(void) {
+    __atomic_store_n(&stopFlag, true, __ATOMIC_RELAXED);
+}
+static void waitSearch(void) {
+    if (searching) {
+        pthread_join(searchThread, NULL);
+        searching = false;
     }
-
-    Undo u;
-    applyMove(board, m, &u);
 }
 
+int main(int argc, char** argv) {
+    engineInit();
 
-int main() {
-    initAttackTables();
-    Board board;
-    boardSetup(&board);
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        runBench(argc > 2 ? atoi(argv[2]) : BENCH_DEPTH);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "epd") == 0) {
+        return runBatch(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "server") == 0) {
+        return runServer(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "pgn") == 0) {
+        return runPgn(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "gensfen") == 0) {
+        return runGensfen(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "sfendump") == 0) {
+        return runSfenDump(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "traceanalyze") == 0) {
+        return runTraceAnalyze(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "tune") == 0) {
+        return runTune(argc - 2, argv + 2);
+    }
+    if (argc > 2 && strcmp(argv[1], "evalsave") == 0) {
+        if (argc > 3 && !evalLoadParams(argv[3])) {
+            fprintf(stderr, "cannot load %s\n", argv[3]);
+            return 1;
+        }
+        return evalSaveParams(argv[2]) ? 0 : 1;
+    }
 
-    // printf("%d\n", countMoves(board, 5));
+    // The UCI loop is a client of the engine API (engine.h), like any
+    // embedding program; the subcommands above use the modules directly.
+    EngineContext* engine = engineCreate();
+    if (!engine) {
+        fprintf(stderr, "cannot start the engine thread\n");
+        return 1;
+    }
 
     char line[4096];
 
     while (fgets(line, sizeof(line), stdin)) {
 
-        // Command: uci
-        if (strncmp(line, "uci", 3) == 0) {
-            printf("uciok\n");
+        // Commands read during a search
+        if (strncmp(line, "isready", 7) == 0) {
+            printf("readyok\n");
             fflush(stdout);
+            continue;
         }
-        // Command: isready
-        else if (strncmp(line, "isready", 7) == 0) {
-            printf("readyok\n");
+        if (strncmp(line, "stop", 4) == 0) {
+            stopSearch();
+            waitSearch();
+            continue;
+        }
+        if (strncmp(line, "ponderhit", 9) == 0) {
+            __atomic_store_n(&ponderhitFlag, true, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (strncmp(line, "quit", 4) == 0) {
+            stopSearch();
+            break;
+        }
+        waitSearch();
+
+        // Command: uci
+        if (strncmp(line, "uci", 3) == 0 && (line[3] == '\n' || line[3] == '\r' || line[3] == '\0')) {
+            printf("id name chess-engine\n");
+            printf("id author Dark74A\n");
+            printf("option name Hash type spin default %d min 1 max 65536\n", TT_DEFAULT_MB);
+            printf("option name MultiPV type spin default 1 min 1 max %d\n", MAX_MULTIPV);
+            printf("option name BookFile type string default <empty>\n");
+            printf("option name BookBestMove type check default false\n");
+            printf("option name SyzygyPath type string default <empty>\n");
+            printf("option name SyzygyProbeDepth type spin default 1 min 1 max 100\n");
+            printf("option name EvalFile type string default <empty>\n");
+            printf("option name Deterministic type check default false\n");
+            printf("option name Ponder type check default false\n");
+            printf("uciok\n");
             fflush(stdout);
         }
         // Command: ucinewgame
         else if (strncmp(line, "ucinewgame", 10) == 0) {
-            boardSetup(&board);
+            engineSetPosition(engine, NULL, NULL);
+            engineNewGame(engine);
+            ttClear();
+        }
+        // Command: setoption name <id> value <x>
+        else if (strncmp(line, "setoption", 9) == 0) {
+            int value;
+            char* opt;
+            if ((opt = strstr(line, "name Hash value")) && sscanf(opt, "name Hash value %d", &value) == 1) {
+                ttResize((size_t)value);
+            } else if ((opt = strstr(line, "name MultiPV value")) && sscanf(opt, "name MultiPV value %d", &value) == 1) {
+                multiPVOption = value < 1 ? 1 : (value > MAX_MULTIPV ? MAX_MULTIPV : value);
+            } else if ((opt = strstr(line, "name SyzygyProbeDepth value")) && sscanf(opt, "name SyzygyProbeDepth value %d", &value) == 1) {
+                tbProbeDepth = value < 1 ? 1 : (value > 100 ? 100 : value);
+            } else if ((opt = strstr(line, "name BookFile value "))) {
+                opt += strlen("name BookFile value ");
+                opt[strcspn(opt, "\r\n")] = '\0';
+                if (bookOpen(opt)) {
+                    printf("info string book %s loaded\n", opt);
+                } else if (strcmp(opt, "<empty>") && *opt) {
+                    printf("info string cannot open book %s\n", opt);
+                }
+                fflush(stdout);
+            } else if ((opt = strstr(line, "name Deterministic value "))) {
+                deterministicOption = strncmp(opt + strlen("name Deterministic value "), "true", 4) == 0;
+            } else if ((opt = strstr(line, "name BookBestMove value "))) {
+                bookBestOnly = strncmp(opt + strlen("name BookBestMove value "), "true", 4) == 0;
+            } else if ((opt = strstr(line, "name EvalFile value "))) {
+                opt += strlen("name EvalFile value ");
+                opt[strcspn(opt, "\r\n")] = '\0';
+                if (!*opt || !strcmp(opt, "<empty>")) {
+                    evalResetParams();
+                } else if (evalLoadParams(opt)) {
+                    printf("info string evaluation parameters loaded from %s\n", opt);
+                } else {
+                    printf("info string cannot load evaluation parameters from %s\n", opt);
+                }
+                fflush(stdout);
+            } else if ((opt = strstr(line, "name SyzygyPath value "))) {
+                opt += strlen("name SyzygyPath value ");
+                opt[strcspn(opt, "\r\n")] = '\0';
+                int found = tbInit(opt);
+                printf("info string found %d tablebases, up to %d pieces\n", found, tbLargest);
+                fflush(stdout);
+            }
+        }
+        // Command: bench [depth]
+        else if (strncmp(line, "bench", 5) == 0) {
+            int depth = BENCH_DEPTH;
+            sscanf(line, "bench %d", &depth);
+            runBench(depth);
+        }
+        // Command: stats (counters of the last search, needs make STATS=1)
+        else if (strncmp(line, "stats", 5) == 0) {
+            engineRun(engine, printStatsJob, NULL);
+        }
+        // Command: trace <file> | trace off (needs make TRACE=1)
+        else if (strncmp(line, "trace", 5) == 0) {
+            char path[1024];
+            if (sscanf(line, "trace %1023s", path) != 1 || !strcmp(path, "off")) {
+                traceStop();
+            } else if (traceStart(path)) {
+                printf("info string tracing searches to %s\n", path);
+                fflush(stdout);
+            }
+        }
+        // Command: tbprobe (debug: raw WDL and DTZ of the position from the tables)
+        else if (strncmp(line, "tbprobe", 7) == 0) {
+            Board board;
+            engineGetPosition(engine, &board);
+            int wdlOk, dtzOk;
+            int wdl = tbProbeWDL(&board, &wdlOk);
+            int dtz = tbProbeDTZ(&board, &dtzOk);
+            if (!wdlOk) {
+                printf("info string tbprobe failed\n");
+            } else if (!dtzOk) {
+                printf("info string tbprobe wdl %d dtz none\n", wdl);
+            } else {
+                printf("info string tbprobe wdl %d dtz %d\n", wdl, dtz);
+            }
+            fflush(stdout);
+        }
+        // Command: evalcache [clear] (debug: hit rate of the evaluation cache)
+        else if (strncmp(line, "evalcache", 9) == 0) {
+            engineRun(engine, evalCacheJob, strstr(line, "clear"));
         }
         // Command: position [startpos|fen] moves ...
         else if (strncmp(line, "position", 8) == 0) {
-            char* ptr = line + 9;
-            if (strncmp(ptr, "startpos", 8) == 0) {
-                boardSetup(&board);
-                ptr += 8;
-            } else if (strncmp(ptr, "fen", 3) == 0) {
-                ptr += 3;
-            }
-
-            char* moves = strstr(ptr, "moves");
-            if (moves) {
-                moves += 6;
-                char movesCopy[2048];
-                strncpy(movesCopy, moves, sizeof(movesCopy)-1);
-                movesCopy[sizeof(movesCopy)-1] = '\0';
-                char* move = strtok(movesCopy, " \n");
-                while (move) {
-                    applyUciMove(&board, move);
-                    move = strtok(NULL, " \n");
-                }
+            char *fen, *moves;
+            splitPositionCommand(line, &fen, &moves);
+            if (!engineSetPosition(engine, fen, moves)) {
+                printf("info string invalid position, using the start position\n");
+                fflush(stdout);
+                engineSetPosition(engine, NULL, NULL);
             }
         }
         // Command: go ...
@@ -118,43 +350,30 @@ int main() {
                 int depth = 1;
                 sscanf(line, "go perft %d", &depth);
 
-                uint64_t nodes = countMoves(&board, depth);
+                uint64_t nodes = enginePerft(engine, depth);
                 printf("nodes %llu\n", (unsigned long long)nodes);
                 fflush(stdout);
                 continue;
             }
 
-            int searchDepth = 4;
-            char* depthPtr = strstr(line, "depth");
-            if (depthPtr) {
-                sscanf(depthPtr, "depth %d", &searchDepth);
-            }
-
-            Move bestMove = findBestMove(&board, searchDepth);
+            Board board;
+            engineGetPosition(engine, &board);
+            SearchLimits limits;
+            parseGoLimits(line, &board, &limits);
+            limits.multiPV = multiPVOption;
+            limits.deterministic = deterministicOption;
 
-            if (bestMove.from < 0 || bestMove.from > 63) {
-                printf("bestmove 0000\n");
-                fflush(stdout);
-                continue;
-            }
-
-
-            printf("bestmove %c%c%c%c",
-                fileChar(bestMove.from % 8), rankChar(bestMove.from / 8),
-                fileChar(bestMove.to   % 8), rankChar(bestMove.to   / 8)
-            );
-            if (bestMove.promotionPiece != 0) {
-                printf("%c", promotionChar(bestMove.promotionPiece));
-            }
-            printf("\n");
-            fflush(stdout);
+            startSearch(engine, &limits);
         }
+    }
 
-        // Command: quit
-        else if (strncmp(line, "quit", 4) == 0) {
-            break;
-        }
+    // end of input: a search that only stop would end is stopped, others finish
+    if (searching && (goJob.limits.ponder || goJob.limits.infinite)) {
+        stopSearch();
     }
+    waitSearch();
+    engineDestroy(engine);
+    traceStop();
 
     return 0;
 }
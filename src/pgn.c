@@ -0,0 +1,436 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pgn.h"
+
+// ----------------- PGN reader -----------------
+
+bool pgnOpen(PgnReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    r->data = (const char*)data;
+    r->size = (size_t)st.st_size;
+
+    // UTF-8 byte order mark
+    if (r->size >= 3 && !memcmp(r->data, "\xEF\xBB\xBF", 3))
+        r->pos = 3;
+    return true;
+}
+void pgnClose(PgnReader* r) {
+    if (r->data)
+        munmap((void*)r->data, r->size);
+    memset(r, 0, sizeof(*r));
+}
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// [Name "value"] starting at r->pos; leaves r->pos after the closing bracket.
+static void readTag(PgnReader* r, PgnGame* g) {
+    const char* s = r->data;
+    size_t end = r->size;
+    size_t i = r->pos + 1;
+
+    while (i < end && (s[i] == ' ' || s[i] == '\t')) i++;
+    size_t name = i;
+    while (i < end && !isBlank(s[i]) && s[i] != '"' && s[i] != ']') i++;
+    size_t nameEnd = i;
+
+    while (i < end && s[i] != '"' && s[i] != ']' && s[i] != '\n') i++;
+    size_t value = i, valueEnd = i;
+    if (i < end && s[i] == '"') {
+        value = ++i;
+        while (i < end && s[i] != '"' && s[i] != '\n') {
+            if (s[i] == '\\' && i + 1 < end) i++;
+            i++;
+        }
+        valueEnd = i;
+    }
+    while (i < end && s[i] != ']' && s[i] != '\n') i++;
+    if (i < end && s[i] == ']') i++;
+    r->pos = i;
+
+    if (g->tagCount < PGN_MAX_TAGS && nameEnd > name) {
+        PgnTag* t = &g->tags[g->tagCount++];
+        t->name = s + name;
+        t->nameLen = (int)(nameEnd - name);
+        t->value = s + value;
+        t->valueLen = (int)(valueEnd - value);
+    }
+}
+
+static int parseResult(const char* s, int len) {
+    if (len == 3 && !memcmp(s, "1-0", 3)) return PGN_WHITE_WINS;
+    if (len == 3 && !memcmp(s, "0-1", 3)) return PGN_BLACK_WINS;
+    if (len == 7 && !memcmp(s, "1/2-1/2", 7)) return PGN_DRAW;
+    return PGN_UNKNOWN;
+}
+
+/*
+ * A game is its tag section plus the movetext up to the next line that
+ * starts with '[' outside a comment, so a missing result token or blank
+ * line does not merge two games.
+ */
+bool pgnNextGame(PgnReader* r, PgnGame* g) {
+    const char* s = r->data;
+    size_t end = r->size;
+
+    g->tagCount = 0;
+    g->result = PGN_UNKNOWN;
+
+    while (r->pos < end && isBlank(s[r->pos])) r->pos++;
+    if (r->pos >= end)
+        return false;
+
+    while (r->pos < end && s[r->pos] == '[') {
+        readTag(r, g);
+        while (r->pos < end && isBlank(s[r->pos])) r->pos++;
+    }
+
+    size_t i = r->pos;
+    bool lineStart = false;
+    while (i < end) {
+        char c = s[i];
+        if (c == '[' && lineStart)
+            break;
+        if (c == '{') {
+            const char* close = memchr(s + i, '}', end - i);
+            i = close ? (size_t)(close - s) + 1 : end;
+            lineStart = false;
+            continue;
+        }
+        if (c == ';') {
+            const char* nl = memchr(s + i, '\n', end - i);
+            i = nl ? (size_t)(nl - s) : end;
+            continue;
+        }
+        if (c == '\n') lineStart = true;
+        else if (c != ' ' && c != '\t' && c != '\r') lineStart = false;
+        i++;
+    }
+    g->moves = s + r->pos;
+    g->movesLen = i - r->pos;
+    r->pos = i;
+
+    const PgnTag* result = pgnFindTag(g, "Result");
+    if (result)
+        g->result = parseResult(result->value, result->valueLen);
+    return true;
+}
+
+const PgnTag* pgnFindTag(const PgnGame* g, const char* name) {
+    int len = (int)strlen(name);
+    for (int i = 0; i < g->tagCount; i++) {
+        if (g->tags[i].nameLen == len && !memcmp(g->tags[i].name, name, (size_t)len))
+            return &g->tags[i];
+    }
+    return NULL;
+}
+
+// ----------------- SAN decoding -----------------
+
+static int pieceFromLetter(char c) {
+    switch (c) {
+        case 'N': case 'n': return KNIGHT;
+        case 'B': case 'b': return BISHOP;
+        case 'R': case 'r': return ROOK;
+        case 'Q': case 'q': return QUEEN;
+        case 'K': case 'k': return KING;
+        default:            return 0;
+    }
+}
+
+/*
+ * Origins straight from the attack tables, legality from the pin mask.
+ * Only used out of check and away from en passant, where a pinned piece
+ * staying on its pin line is the whole legality rule; everything else goes
+ * through the full legal move generator.
+ */
+static bool sanFastPath(Board* b, int piece, int to, int fromFile, int fromRank, int promo, Move* out) {
+    bool white = b->mover == WHITE;
+    U64 ours = white ? b->whitePieces : b->blackPieces;
+    U64 theirs = white ? b->blackPieces : b->whitePieces;
+    U64 occ = b->occupied;
+    U64 target = bit(to);
+    U64 origins = 0;
+
+    if (ours & target)
+        return false;
+
+    switch (piece) {
+        case PAWN: {
+            if (to == b->enPassantSquare)
+                return false;
+            U64 pawns = white ? b->wp : b->bp;
+            if (theirs & target) {
+                origins = pawnAttacks[colorIndex(b->mover) ^ 1][to] & pawns;
+            } else {
+                int back = white ? -8 : 8;
+                int one = to + back;
+                if (one < 0 || one > 63) return false;
+                if (pawns & bit(one)) {
+                    origins = bit(one);
+                } else if (!(occ & bit(one)) && rankOf(to) == (white ? 3 : 4)
+                           && (pawns & bit(one + back))) {
+                    origins = bit(one + back);
+                }
+            }
+            break;
+        }
+        case KNIGHT: origins = knightAttacks[to] & (white ? b->wn : b->bn); break;
+        case BISHOP: origins = bishopAttacksFrom(to, occ) & (white ? b->wb : b->bb); break;
+        case ROOK:   origins = rookAttacksFrom(to, occ) & (white ? b->wr : b->br); break;
+        case QUEEN:
+            origins = (bishopAttacksFrom(to, occ) | rookAttacksFrom(to, occ)) & (white ? b->wq : b->bq);
+            break;
+        default: return false;
+    }
+
+    AttackInfo ai;
+    computeAttackInfo(b, &ai);
+    int ksq = ai.kingSq[colorIndex(b->mover)];
+    if (ai.checkers || ksq < 0)
+        return false;
+
+    int matches = 0, from = -1;
+    while (origins) {
+        int sq = pop_lsb(&origins);
+        if ((fromFile >= 0 && fileOf(sq) != fromFile) || (fromRank >= 0 && rankOf(sq) != fromRank))
+            continue;
+        if ((ai.pinned & bit(sq)) && !(lineMask[ksq][sq] & target))
+            continue;
+        from = sq;
+        matches++;
+    }
+    if (matches != 1)
+        return false;
+
+    bool promotes = piece == PAWN && (rankOf(to) == 0 || rankOf(to) == 7);
+    if (promo && !promotes)
+        return false;
+    out->from = from;
+    out->to = to;
+    out->promotionPiece = promotes ? (promo ? promo : QUEEN) : 0;
+    out->score = 0;
+    return true;
+}
+
+/*
+ * The SAN is split into piece, target square, optional origin file / rank
+ * and promotion, then matched against the legal moves: exactly one must
+ * fit. A full origin square is accepted too, so "Ng1f3", "e2-e4" and
+ * "e7e8q" resolve the same way.
+ */
+bool sanToMove(Board* b, const char* san, int len, Move* out) {
+    while (len > 0 && strchr("+#!?", san[len - 1])) len--;
+    if (len < 2)
+        return false;
+
+    int piece = PAWN, promo = 0;
+    int to, fromFile = -1, fromRank = -1;
+    bool castle = san[0] == 'O' || san[0] == '0';
+
+    if (castle) {
+        int from = b->mover == WHITE ? 4 : 60;
+        piece = KING;
+        to = len >= 5 ? from - 2 : from + 2;
+        fromFile = fileOf(from);
+        fromRank = rankOf(from);
+    } else {
+        int i = 0;
+        if (strchr("NBRQK", san[0])) {
+            piece = pieceFromLetter(san[0]);
+            i = 1;
+        }
+
+        char last = san[len - 1];
+        if (piece == PAWN && len >= 3 && pieceFromLetter(last) && pieceFromLetter(last) != KING
+            && (strchr("NBRQ", last) || san[len - 2] == '1' || san[len - 2] == '8')) {
+            promo = pieceFromLetter(last);
+            len--;
+            if (san[len - 1] == '=') len--;
+        }
+
+        if (len - i < 2)
+            return false;
+        char tf = san[len - 2], tr = san[len - 1];
+        if (tf < 'a' || tf > 'h' || tr < '1' || tr > '8')
+            return false;
+        to = sq_index(tr - '1', tf - 'a');
+
+        for (int k = i; k < len - 2; k++) {
+            char c = san[k];
+            if (c >= 'a' && c <= 'h')      fromFile = c - 'a';
+            else if (c >= '1' && c <= '8') fromRank = c - '1';
+            else if (c != 'x' && c != ':' && c != '-') return false;
+        }
+        if (piece == PAWN && fromFile < 0)
+            fromFile = fileOf(to);
+    }
+
+    if (!castle && piece != KING && sanFastPath(b, piece, to, fromFile, fromRank, promo, out))
+        return true;
+
+    Move legal[256];
+    uint64_t count = 0;
+    int matches = 0;
+    generateLegalMovesToArray(b, legal, &count, 256);
+    for (uint64_t k = 0; k < count; k++) {
+        Move m = legal[k];
+        if (m.to != to || (pieceAt(b, m.from) & 7) != piece)
+            continue;
+        if ((fromFile >= 0 && fileOf(m.from) != fromFile) || (fromRank >= 0 && rankOf(m.from) != fromRank))
+            continue;
+        if (m.promotionPiece != (m.promotionPiece && !promo ? QUEEN : promo))
+            continue;
+        *out = m;
+        matches++;
+    }
+    return matches == 1;
+}
+
+// ----------------- Replay -----------------
+
+int pgnReplay(const PgnGame* g, Board* b, PgnPositionFn fn, void* ctx) {
+    const PgnTag* fen = pgnFindTag(g, "FEN");
+    if (fen) {
+        char buf[256];
+        int n = fen->valueLen < (int)sizeof(buf) - 1 ? fen->valueLen : (int)sizeof(buf) - 1;
+        memcpy(buf, fen->value, (size_t)n);
+        buf[n] = '\0';
+        if (!parseFEN(b, buf))
+            return -1;
+    } else {
+        boardSetup(b);
+    }
+    resetKeyHistory();
+
+    const char* p = g->moves;
+    const char* end = g->moves + g->movesLen;
+    int ply = 0, variation = 0;
+
+    while (p < end) {
+        char c = *p;
+        if (isBlank(c) || c == '}') {       // a '}' with no '{' would end no token
+            p++;
+        } else if (c == '{') {
+            const char* close = memchr(p, '}', (size_t)(end - p));
+            p = close ? close + 1 : end;
+        } else if (c == ';' || c == '%') {
+            const char* nl = memchr(p, '\n', (size_t)(end - p));
+            p = nl ? nl + 1 : end;
+        } else if (c == '(') {
+            variation++;
+            p++;
+        } else if (c == ')') {
+            if (variation) variation--;
+            p++;
+        } else {
+            const char* tok = p;
+            while (p < end && !isBlank(*p) && !strchr("{}();", *p)) p++;
+            if (variation || c == '$')
+                continue;
+
+            // result token ends the game; "12." / "12..." / "12.e4" move numbers
+            if (c == '*' || parseResult(tok, (int)(p - tok)) != PGN_UNKNOWN)
+                break;
+            while (tok < p && *tok >= '0' && *tok <= '9') tok++;
+            while (tok < p && *tok == '.') tok++;
+            if (tok == p)
+                continue;
+
+            Move m;
+            if (!sanToMove(b, tok, (int)(p - tok), &m) || keyHistoryCount >= MAX_GAME_PLY)
+                return -1 - ply;
+            if (fn && !fn(b, m, ply, g, ctx))
+                return ply;
+
+            Undo u;
+            pushKeyHistory(b->key);
+            applyMove(b, m, &u);
+            ply++;
+        }
+    }
+    return ply;
+}
+
+// ----------------- "chess pgn" command -----------------
+
+static bool printFen(Board* b, Move played, int ply, const PgnGame* g, void* ctx) {
+    (void)played; (void)ply; (void)g; (void)ctx;
+    char fen[FEN_MAX];
+    boardToFEN(b, fen);
+    puts(fen);
+    return true;
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * chess pgn <file> [fens]
+ * Replays every game and reports throughput; with "fens" each position is
+ * written as a FEN line, ready to be piped into "chess epd -".
+ */
+int runPgn(int argc, char** argv) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: chess pgn <file> [fens]\n");
+        return 1;
+    }
+    PgnReader reader;
+    if (!pgnOpen(&reader, argv[0])) {
+        fprintf(stderr, "cannot open %s\n", argv[0]);
+        return 1;
+    }
+    PgnPositionFn fn = argc > 1 && !strcmp(argv[1], "fens") ? printFen : NULL;
+    if (fn)
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+    PgnGame game;
+    Board board;
+    uint64_t games = 0, plies = 0, bad = 0;
+    double start = nowSeconds();
+
+    while (pgnNextGame(&reader, &game)) {
+        int n = pgnReplay(&game, &board, fn, NULL);
+        games++;
+        if (n < 0) {
+            bad++;
+            n = -1 - n;
+        }
+        plies += (uint64_t)n;
+    }
+
+    double elapsed = nowSeconds() - start;
+    fflush(stdout);
+    fprintf(stderr, "%llu games, %llu plies in %.2fs (%.0f plies/s), %llu games with unreadable moves\n",
+            (unsigned long long)games, (unsigned long long)plies, elapsed,
+            elapsed > 0 ? plies / elapsed : 0.0, (unsigned long long)bad);
+    pgnClose(&reader);
+    return 0;
+}
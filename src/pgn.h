@@ -0,0 +1,70 @@
+#ifndef PGN_H
+#define PGN_H
+
+#include "bitboard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Streaming PGN reader. The file is memory-mapped and games are handed out
+ * one at a time; tag names, tag values and the movetext all point into the
+ * mapping, so nothing is copied until a game is replayed.
+ */
+
+#define PGN_MAX_TAGS 32
+
+enum { PGN_WHITE_WINS = 1, PGN_DRAW = 0, PGN_BLACK_WINS = -1, PGN_UNKNOWN = 2 };
+
+typedef struct {
+    const char* name;
+    const char* value;          // without the quotes, escapes left in place
+    int nameLen;
+    int valueLen;
+} PgnTag;
+
+typedef struct {
+    PgnTag tags[PGN_MAX_TAGS];
+    int tagCount;
+    const char* moves;          // movetext, up to (not including) the next game
+    size_t movesLen;
+    int result;                 // PGN_WHITE_WINS .. PGN_UNKNOWN, from the Result tag
+} PgnGame;
+
+typedef struct {
+    const char* data;
+    size_t size;
+    size_t pos;
+} PgnReader;
+
+bool pgnOpen(PgnReader* r, const char* path);
+void pgnClose(PgnReader* r);
+bool pgnNextGame(PgnReader* r, PgnGame* g);
+const PgnTag* pgnFindTag(const PgnGame* g, const char* name);
+
+/* SAN (or long algebraic) resolved against the legal moves of b */
+bool sanToMove(Board* b, const char* san, int len, Move* out);
+
+/*
+ * Called for every position of a replayed game with the move played from
+ * it; return false to stop the replay early. keyHistory holds the game so
+ * far, so repetition checks work inside the callback.
+ */
+typedef bool (*PgnPositionFn)(Board* b, Move played, int ply, const PgnGame* g, void* ctx);
+
+/*
+ * Sets b to the game's start position (FEN tag or the initial position) and
+ * plays the main line, skipping comments, variations and NAGs. Returns the
+ * number of plies played, or -1 - plies if a move could not be resolved.
+ */
+int pgnReplay(const PgnGame* g, Board* b, PgnPositionFn fn, void* ctx);
+
+/* "chess pgn <file> [fens]" */
+int runPgn(int argc, char** argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PGN_H */
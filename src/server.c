@@ -0,0 +1,515 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "engine.h"
+
+// ----------------- UCI server -----------------
+
+/*
+ * chess server <socket> [threads N] [hash MB] [sessions N]
+ *
+ * Every connection to the Unix domain socket is one UCI session with its
+ * own position, game history and options. One thread runs the epoll loop:
+ * it accepts connections, reads lines and answers the cheap commands
+ * itself. "go" and "go perft" are queued for a fixed pool of search
+ * threads, which write info and bestmove lines straight to the session.
+ *
+ * The attack tables, the transposition table and the evaluation
+ * parameters are set up once and shared by all sessions; move-ordering
+ * tables and the eval cache belong to the pool thread that runs a search.
+ * For that reason there is no Deterministic option here: a deterministic
+ * search clears the shared TT, which would wipe it under the other
+ * sessions, and their writes would still make it irreproducible.
+ * While a session's search runs, only "stop", "ponderhit", "isready" and
+ * "quit" are handled; anything after them waits in the input buffer until
+ * the search is done, so commands keep their order.
+ */
+
+#define SERVER_STACK_SIZE (32u << 20)   // as for the batch workers
+#define SERVER_LINE_MAX 8192            // input buffer, longer lines are dropped
+#define SERVER_DEFAULT_SESSIONS 1024
+#define SERVER_SEND_TIMEOUT_S 10        // a client that stops reading loses its output
+
+typedef struct Session Session;
+struct Session {
+    int fd;
+    char in[SERVER_LINE_MAX];           // received, not yet handled
+    size_t inLen;
+    bool reading;                       // EPOLLIN armed
+
+    Board board;
+    U64 keys[MAX_GAME_PLY];             // repetition history of the position
+    int keyCount;
+    int multiPV;
+
+    // the job, owned by the pool from queueing until it is on the done list
+    bool busy;
+    bool perft;
+    int perftDepth;
+    SearchLimits limits;
+    bool stop;                          // SearchLimits.stop
+    bool ponderhit;                     // SearchLimits.ponderhit
+    bool closing;                       // peer gone or "quit": free once idle
+
+    pthread_mutex_t outLock;
+    bool outFailed;                     // stop writing after a send error
+    Session* next;                      // pool queue, then done list
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    Session* head;                      // queued jobs
+    Session* tail;
+    Session* done;                      // finished jobs, for the event loop
+    int doneFd;                         // eventfd, written when done grows
+} pool;
+
+static volatile sig_atomic_t serverInterrupted = 0;
+
+static void onSignal(int sig) {
+    (void)sig;
+    serverInterrupted = 1;
+}
+
+// ----------------- Session output -----------------
+
+static void sessionSend(Session* s, const char* text, size_t len) {
+    pthread_mutex_lock(&s->outLock);
+    while (len > 0 && !s->outFailed) {
+        ssize_t n = send(s->fd, text, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            s->outFailed = true;
+            break;
+        }
+        text += n;
+        len -= (size_t)n;
+    }
+    pthread_mutex_unlock(&s->outLock);
+}
+static void sessionPrintf(Session* s, const char* fmt, ...) {
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        sessionSend(s, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+static void sessionInfo(const SearchInfo* info, void* data) {
+    Session* s = (Session*) data;
+    if (info->depth == 0) {
+        char move[6];
+        moveToString(info->pv[0], move);
+        sessionPrintf(s, "info string book move %s\n", move);
+        return;
+    }
+    char line[SEARCH_INFO_MAX];
+    int n = formatSearchInfo(info, line, sizeof(line));
+    sessionSend(s, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+}
+
+// ----------------- Search pool -----------------
+
+static void runSessionJob(Session* s) {
+    Board b = s->board;
+
+    if (s->perft) {
+        sessionPrintf(s, "nodes %llu\n", (unsigned long long)countMoves(&b, s->perftDepth));
+        return;
+    }
+
+    resetKeyHistory();
+    for (int i = 0; i < s->keyCount; i++) {
+        pushKeyHistory(s->keys[i]);
+    }
+    SearchLimits limits = s->limits;
+    limits.stop = &s->stop;
+    limits.ponderhit = &s->ponderhit;
+    limits.onInfo = sessionInfo;
+    limits.infoData = s;
+
+    SearchResult result;
+    Move best = findBestMove(&b, &limits, &result);
+    if (best.from < 0 || best.from > 63) {
+        sessionPrintf(s, "bestmove 0000\n");
+    } else if (result.ponder.from >= 0) {
+        char move[6], ponder[6];
+        moveToString(best, move);
+        moveToString(result.ponder, ponder);
+        sessionPrintf(s, "bestmove %s ponder %s\n", move, ponder);
+    } else {
+        char move[6];
+        moveToString(best, move);
+        sessionPrintf(s, "bestmove %s\n", move);
+    }
+}
+static void* poolWorker(void* arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.head) {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+        Session* s = pool.head;
+        pool.head = s->next;
+        if (!pool.head) pool.tail = NULL;
+        pthread_mutex_unlock(&pool.lock);
+
+        if (!__atomic_load_n(&s->closing, __ATOMIC_RELAXED)) {
+            runSessionJob(s);
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        s->next = pool.done;
+        pool.done = s;
+        pthread_mutex_unlock(&pool.lock);
+        uint64_t one = 1;
+        ssize_t written = write(pool.doneFd, &one, sizeof(one));     // only fails on counter overflow
+        (void)written;
+    }
+    return NULL;
+}
+static void queueJob(Session* s) {
+    s->busy = true;
+    __atomic_store_n(&s->stop, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->ponderhit, false, __ATOMIC_RELAXED);
+    s->next = NULL;
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.tail) pool.tail->next = s;
+    else pool.head = s;
+    pool.tail = s;
+    pthread_cond_signal(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// ----------------- Commands -----------------
+
+static void sessionReset(Session* s) {
+    boardSetup(&s->board);
+    s->keyCount = 0;
+}
+static void handleSetOption(Session* s, const char* line) {
+    const char* opt;
+    int value;
+    if ((opt = strstr(line, "name MultiPV value")) && sscanf(opt, "name MultiPV value %d", &value) == 1) {
+        s->multiPV = value < 1 ? 1 : (value > 256 ? 256 : value);
+    } else if (strstr(line, "name Deterministic value ")) {
+        sessionPrintf(s, "info string Deterministic is not available in server mode, "
+                         "the sessions share one transposition table\n");
+    } else {
+        sessionPrintf(s, "info string only MultiPV is per session, "
+                         "the rest is set when the server starts\n");
+    }
+}
+// Returns false once the session should be closed.
+static bool handleCommand(Session* s, char* line) {
+    if (!strncmp(line, "isready", 7)) {
+        sessionPrintf(s, "readyok\n");
+    } else if (!strncmp(line, "stop", 4)) {
+        __atomic_store_n(&s->stop, true, __ATOMIC_RELAXED);
+    } else if (!strncmp(line, "ponderhit", 9)) {
+        __atomic_store_n(&s->ponderhit, true, __ATOMIC_RELAXED);
+    } else if (!strncmp(line, "quit", 4)) {
+        return false;
+    } else if (!strncmp(line, "ucinewgame", 10)) {
+        sessionReset(s);
+    } else if (!strncmp(line, "uci", 3)) {
+        sessionPrintf(s, "id name chess-engine\nid author Dark74A\n"
+                         "option name MultiPV type spin default 1 min 1 max 256\n"
+                         "option name Ponder type check default false\nuciok\n");
+    } else if (!strncmp(line, "setoption", 9)) {
+        handleSetOption(s, line);
+    } else if (!strncmp(line, "position", 8)) {
+        char *fen, *moves;
+        splitPositionCommand(line, &fen, &moves);
+        if (!parsePosition(fen, moves, &s->board, s->keys, &s->keyCount)) {
+            sessionPrintf(s, "info string invalid position, using the start position\n");
+            sessionReset(s);
+        }
+    } else if (!strncmp(line, "go", 2)) {
+        s->perft = strstr(line, "perft") != NULL;
+        if (s->perft) {
+            s->perftDepth = 1;
+            sscanf(line, "go perft %d", &s->perftDepth);
+        } else {
+            parseGoLimits(line, &s->board, &s->limits);
+            s->limits.multiPV = s->multiPV;
+        }
+        queueJob(s);
+    }
+    return true;
+}
+// Handles complete lines in order; while a job runs only the ones that
+// may interrupt it. Returns false once the session should be closed.
+static bool processInput(Session* s) {
+    size_t start = 0;
+    bool open = true;
+
+    while (open) {
+        char* nl = memchr(s->in + start, '\n', s->inLen - start);
+        if (!nl)
+            break;
+        char* line = s->in + start;
+        if (s->busy && strncmp(line, "stop", 4) && strncmp(line, "ponderhit", 9) &&
+            strncmp(line, "isready", 7) && strncmp(line, "quit", 4))
+            break;
+        *nl = '\0';
+        if (nl > line && nl[-1] == '\r') nl[-1] = '\0';
+        start = (size_t)(nl - s->in) + 1;
+        open = handleCommand(s, line);
+    }
+
+    memmove(s->in, s->in + start, s->inLen - start);
+    s->inLen -= start;
+    if (s->inLen == sizeof(s->in) && !memchr(s->in, '\n', s->inLen)) {
+        sessionPrintf(s, "info string line too long, dropped\n");
+        s->inLen = 0;
+    }
+    return open;
+}
+
+// ----------------- Event loop -----------------
+
+static void setReading(int epfd, Session* s, bool reading) {
+    if (s->reading == reading)
+        return;
+    struct epoll_event ev = { .events = reading ? EPOLLIN : 0, .data.ptr = s };
+    epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+    s->reading = reading;
+}
+static void freeSession(Session* s) {
+    close(s->fd);
+    pthread_mutex_destroy(&s->outLock);
+    free(s);
+}
+// A busy session is only marked; the event loop frees it when its job is done.
+static void closeSession(int epfd, Session* s, int* sessionCount) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    shutdown(s->fd, SHUT_RD);
+    (*sessionCount)--;
+    if (s->busy) {
+        __atomic_store_n(&s->closing, true, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->stop, true, __ATOMIC_RELAXED);
+    } else {
+        freeSession(s);
+    }
+}
+static void sessionInput(int epfd, Session* s, uint32_t events, int* sessionCount) {
+    if (!s->reading) {
+        // only a hangup wakes a session that is not being read
+        if (events & (EPOLLHUP | EPOLLERR))
+            closeSession(epfd, s, sessionCount);
+        return;
+    }
+    ssize_t n = read(s->fd, s->in + s->inLen, sizeof(s->in) - s->inLen);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n <= 0) {
+        closeSession(epfd, s, sessionCount);
+        return;
+    }
+    s->inLen += (size_t)n;
+    if (!processInput(s)) {
+        closeSession(epfd, s, sessionCount);
+        return;
+    }
+    // a busy session with a full buffer is not read until its job is done
+    setReading(epfd, s, s->inLen < sizeof(s->in));
+}
+static void acceptSessions(int epfd, int listenFd, int* sessionCount, int maxSessions) {
+    for (;;) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0)
+            return;
+        if (*sessionCount >= maxSessions) {
+            const char msg[] = "info string too many sessions\n";
+            ssize_t sent = send(fd, msg, sizeof(msg) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+            (void)sent;
+            close(fd);
+            continue;
+        }
+
+        Session* s = (Session*) calloc(1, sizeof(Session));
+        if (!s) {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        s->multiPV = 1;
+        s->reading = true;
+        sessionReset(s);
+        pthread_mutex_init(&s->outLock, NULL);
+        struct timeval timeout = { SERVER_SEND_TIMEOUT_S, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = s };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            freeSession(s);
+            continue;
+        }
+        (*sessionCount)++;
+    }
+}
+static void finishJobs(int epfd, int* sessionCount) {
+    uint64_t count;
+    ssize_t got = read(pool.doneFd, &count, sizeof(count));  // resets the eventfd
+    (void)got;
+
+    pthread_mutex_lock(&pool.lock);
+    Session* s = pool.done;
+    pool.done = NULL;
+    pthread_mutex_unlock(&pool.lock);
+
+    while (s) {
+        Session* next = s->next;
+        s->busy = false;
+        if (s->closing) {
+            freeSession(s);
+        } else if (!processInput(s)) {
+            closeSession(epfd, s, sessionCount);
+        } else {
+            setReading(epfd, s, s->inLen < sizeof(s->in));
+        }
+        s = next;
+    }
+}
+
+static int listenOn(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket left behind by an earlier server is replaced, other files are not
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int runServer(int argc, char** argv) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: chess server <socket> [threads N] [hash MB] [sessions N]\n");
+        return 1;
+    }
+    const char* path = argv[0];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    int hashMb = TT_DEFAULT_MB;
+    int maxSessions = SERVER_DEFAULT_SESSIONS;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "threads"))       threads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "hash"))     hashMb = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "sessions")) maxSessions = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (hashMb < 1) hashMb = 1;
+    if (maxSessions < 1) maxSessions = 1;
+
+    engineInit();
+    ttResize((size_t)hashMb);
+
+    int listenFd = listenOn(path);
+    if (listenFd < 0)
+        return 1;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    pool.doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || pool.doneFd < 0) {
+        perror("epoll");
+        return 1;
+    }
+    // the listening socket and the eventfd are told apart by their tags
+    static int listenTag, doneTag;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listenTag };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.ptr = &doneTag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, pool.doneFd, &ev);
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.wake, NULL);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SERVER_STACK_SIZE);
+    pthread_t* workers = (pthread_t*) calloc((size_t)threads, sizeof(pthread_t));
+    int started = 0;
+    while (workers && started < threads && pthread_create(&workers[started], &attr, poolWorker, NULL) == 0) {
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+    if (started == 0) {
+        fprintf(stderr, "cannot start search threads\n");
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("info string listening on %s, %d search threads, hash %d MB\n", path, started, hashMb);
+    fflush(stdout);
+
+    int sessionCount = 0;
+    struct epoll_event events[64];
+    while (!serverInterrupted) {
+        int n = epoll_wait(epfd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &listenTag) {
+                acceptSessions(epfd, listenFd, &sessionCount, maxSessions);
+            } else if (tag == &doneTag) {
+                finishJobs(epfd, &sessionCount);
+            } else {
+                sessionInput(epfd, (Session*) tag, events[i].events, &sessionCount);
+            }
+        }
+    }
+
+    // open sessions and running searches end with the process
+    close(listenFd);
+    unlink(path);
+    printf("info string server stopped\n");
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "bitboard.h"
+
+// ----------------- Search statistics -----------------
+
+#ifdef SEARCH_STATS
+
+_Thread_local SearchStats searchStats;
+
+uint64_t statsClock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+static double ratio(uint64_t a, uint64_t b) {
+    return b ? (double)a / (double)b : 0.0;
+}
+
+void statsReset(void) {
+    memset(&searchStats, 0, sizeof(searchStats));
+}
+void statsPrint(void) {
+    const SearchStats* s = &searchStats;
+    typedef unsigned long long ull;
+
+    printf("info string stats nodes %llu main %llu quiescence %llu\n",
+           (ull)(s->nodes + s->qnodes), (ull)s->nodes, (ull)s->qnodes);
+    printf("info string stats failhigh %llu first %llu (%.1f%%)\n",
+           (ull)s->failHighs, (ull)s->failHighFirst, percent(s->failHighFirst, s->failHighs));
+    printf("info string stats tt probes %llu hits %llu (%.1f%%) cutoffs %llu\n",
+           (ull)s->ttProbes, (ull)s->ttHits, percent(s->ttHits, s->ttProbes), (ull)s->ttCutoffs);
+    printf("info string stats branching generated %.2f searched %.2f effective %.2f\n",
+           ratio(s->movesGenerated, s->expanded), ratio(s->movesSearched, s->expanded),
+           ratio(s->iterationNodes[1], s->iterationNodes[0]));
+    printf("info string stats qsearch generated %llu captures %llu standpat %llu lazy %llu evals %llu\n",
+           (ull)s->qMovesGenerated, (ull)s->qCapturesSearched,
+           (ull)s->standPatCutoffs, (ull)s->lazyCutoffs, (ull)s->evals);
+    printf("info string stats cycles %llu eval %.1f%% movegen %.1f%% ordering %.1f%% tt %.1f%%\n",
+           (ull)s->cyclesSearch, percent(s->cyclesEval, s->cyclesSearch),
+           percent(s->cyclesMovegen, s->cyclesSearch), percent(s->cyclesOrdering, s->cyclesSearch),
+           percent(s->cyclesTT, s->cyclesSearch));
+    fflush(stdout);
+}
+
+#else
+
+void statsReset(void) {}
+void statsPrint(void) {
+    printf("info string stats not compiled in, rebuild with make STATS=1\n");
+    fflush(stdout);
+}
+
+#endif
@@ -0,0 +1,1146 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "syzygy.h"
+
+/*
+ * Syzygy tablebase probing (format by Ronald de Man). The indexing and
+ * decompression follow the reference prober: a position is mapped to an
+ * index by symmetry reduction and combinatorial encoding of piece groups,
+ * and the value at that index is decoded from canonical-Huffman blocks of
+ * recursively paired symbols.
+ *
+ * This file is a C adaptation of Stockfish's src/syzygy/tbprobe.cpp
+ * (Copyright (C) 2004-2024 The Stockfish developers), which is based on
+ * the original prober by Ronald de Man; the table setup (set_groups,
+ * set_symlen, set_sizes, set_dtz_map) and the probe logic keep its
+ * structure. Like Stockfish, it is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version. It is distributed
+ * WITHOUT ANY WARRANTY; see COPYING.GPL-3 at the top of the tree. Any
+ * binary that links it (chess or libchessengine built with make SYZYGY=1)
+ * is covered by the GPL; default builds use syzygy_stub.c instead.
+ */
+
+#define TB_MAX_DTZ (1 << 18)
+#define TB_MAX_PATHS 16
+#define TB_HASH_SIZE 8192
+
+enum { TB_WDL = 0, TB_DTZ = 1 };
+
+/* per-table flags; all but SINGLE_VALUE describe DTZ tables */
+enum {
+    TB_FLAG_STM = 1, TB_FLAG_MAPPED = 2, TB_FLAG_WIN_PLIES = 4,
+    TB_FLAG_LOSS_PLIES = 8, TB_FLAG_WIDE = 16, TB_FLAG_SINGLE_VALUE = 128
+};
+
+enum { PROBE_CHANGE_STM = -1, PROBE_FAIL = 0, PROBE_OK = 1, PROBE_ZEROING = 2 };
+
+enum { WDL_LOSS = -2, WDL_BLESSED_LOSS = -1, WDL_DRAW = 0, WDL_CURSED_WIN = 1, WDL_WIN = 2 };
+
+typedef uint16_t Sym;
+
+/* left and right child of a paired symbol, 12 bits each */
+typedef struct {
+    uint8_t lr[3];
+} SymPair;
+
+static inline Sym pairLeft(const SymPair* p) { return (Sym)(((p->lr[1] & 0xF) << 8) | p->lr[0]); }
+static inline Sym pairRight(const SymPair* p) { return (Sym)((p->lr[2] << 4) | (p->lr[1] >> 4)); }
+
+/* decoding data of one sub-table (side to move x leading file) */
+typedef struct {
+    uint8_t flags;
+    uint8_t maxSymLen;
+    uint8_t minSymLen;
+    uint32_t numBlocks;
+    size_t blockSize;
+    size_t span;                    // a sparse index entry every span values
+    const uint8_t* lowestSym;       // little-endian Sym per code length
+    const SymPair* btree;
+    const uint8_t* blockLength;     // little-endian uint16 per block
+    uint32_t blockLengthSize;
+    const uint8_t* sparseIndex;     // 6-byte entries: uint32 block, uint16 offset
+    size_t sparseIndexSize;
+    const uint8_t* data;
+    uint64_t* base64;               // lowest code of each length, left-aligned
+    uint8_t* symlen;                // number of values (-1) a symbol expands to
+    int symCount;
+    uint8_t pieces[TB_MAX_PIECES];
+    uint64_t groupIdx[TB_MAX_PIECES + 1];
+    int groupLen[TB_MAX_PIECES + 1];
+    uint16_t mapIdx[4];             // DTZ value maps for win, loss, cursed win, blessed loss
+} PairsData;
+
+typedef struct {
+    int type;
+    int ready;
+    void* base;
+    size_t mapping;
+    const uint8_t* map;             // DTZ value maps
+    U64 key;                        // material with the first side as white
+    U64 key2;                       // material with the first side as black
+    int pieceCount;
+    bool hasPawns;
+    bool hasUniquePieces;
+    uint8_t pawnCount[2];           // leading color, other color
+    PairsData items[2][4];          // [side to move][leading file]
+    char name[16];                  // e.g. "KRPvKR"
+} TBTable;
+
+typedef struct {
+    U64 key;
+    TBTable* wdl;
+    TBTable* dtz;
+} TBHashEntry;
+
+int tbLargest = 0;
+int tbProbeDepth = 1;
+
+static char* tbPaths[TB_MAX_PATHS];
+static int tbPathCount = 0;
+static TBHashEntry tbHash[TB_HASH_SIZE];
+static TBTable** tbTables = NULL;
+static int tbTableCount = 0;
+static pthread_mutex_t tbMapMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* index encoding tables */
+static int mapPawns[64];
+static int mapB1H1H7[64];
+static int mapA1D1D4[64];
+static int mapKK[10][64];
+static uint64_t binomial[TB_MAX_PIECES][64];
+static uint64_t leadPawnIdx[TB_MAX_PIECES][64];
+static uint64_t leadPawnsSize[TB_MAX_PIECES][4];
+static bool tablesInitialized = false;
+
+// ---- little helpers ----
+
+static inline uint16_t readLE16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t readLE32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static inline uint32_t readBE32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+static inline uint64_t readBE64(const uint8_t* p) {
+    return ((uint64_t)readBE32(p) << 32) | readBE32(p + 4);
+}
+
+static inline int offA1H8(int sq) { return rankOf(sq) - fileOf(sq); }
+static inline int edgeDistance(int file) { return file < 4 ? file : 7 - file; }
+static inline int signOf(int v) { return (v > 0) - (v < 0); }
+
+static U64 pieceCodeBoard(const Board* b, int pieceCode) {
+    static const size_t offsets[16] = {
+        0, offsetof(Board, wp), offsetof(Board, wn), offsetof(Board, wb),
+        offsetof(Board, wr), offsetof(Board, wq), offsetof(Board, wk), 0,
+        0, offsetof(Board, bp), offsetof(Board, bn), offsetof(Board, bb),
+        offsetof(Board, br), offsetof(Board, bq), offsetof(Board, bk), 0
+    };
+    size_t off = offsets[pieceCode & 15];
+    return off ? *(const U64*)((const char*)b + off) : 0;
+}
+
+/* exact material signature: a 4-bit count per piece code */
+static U64 materialKey(const Board* b) {
+    U64 key = 0;
+    for (int type = PAWN; type <= KING; type++) {
+        key |= (U64)__builtin_popcountll(pieceCodeBoard(b, type | WHITE)) << (4 * type);
+        key |= (U64)__builtin_popcountll(pieceCodeBoard(b, type | BLACK)) << (4 * (type + 8));
+    }
+    return key;
+}
+
+static int pieceTypeFromChar(char c) {
+    switch (c) {
+        case 'P': return PAWN;
+        case 'N': return KNIGHT;
+        case 'B': return BISHOP;
+        case 'R': return ROOK;
+        case 'Q': return QUEEN;
+        case 'K': return KING;
+        default: return 0;
+    }
+}
+
+static bool hasCastlingRights(const Board* b) {
+    return b->shortWhite || b->longWhite || b->shortBlack || b->longBlack;
+}
+
+static bool isCapture(const Board* b, Move m) {
+    if (b->occupied & bit(m.to)) return true;
+    return (pieceAt(b, m.from) & 7) == PAWN && m.to == b->enPassantSquare;
+}
+
+// ---- encoding tables ----
+
+static void initEncodingTables(void) {
+    int code = 0;
+    for (int s = 0; s < 64; s++) {
+        if (offA1H8(s) < 0)
+            mapB1H1H7[s] = code++;
+    }
+
+    // a1-d1-d4 triangle: squares below the diagonal first, diagonal last
+    int diagonal[4], diagCount = 0;
+    code = 0;
+    for (int s = 0; s <= 27; s++) {
+        if (fileOf(s) > 3) continue;
+        if (offA1H8(s) < 0)
+            mapA1D1D4[s] = code++;
+        else if (!offA1H8(s))
+            diagonal[diagCount++] = s;
+    }
+    for (int i = 0; i < diagCount; i++) {
+        mapA1D1D4[diagonal[i]] = code++;
+    }
+
+    // the 462 legal, non-mirrored king pairs; both-on-diagonal pairs go last
+    int bothIdx[64], bothSq[64], bothCount = 0;
+    code = 0;
+    for (int idx = 0; idx < 10; idx++) {
+        for (int s1 = 0; s1 <= 27; s1++) {
+            if (fileOf(s1) > 3 || offA1H8(s1) > 0) continue;
+            if (mapA1D1D4[s1] != idx || (!idx && s1 != 1)) continue;
+
+            for (int s2 = 0; s2 < 64; s2++) {
+                if ((kingAttacks[s1] | bit(s1)) & bit(s2))
+                    continue;
+                if (!offA1H8(s1) && offA1H8(s2) > 0)
+                    continue;
+                if (!offA1H8(s1) && !offA1H8(s2)) {
+                    bothIdx[bothCount] = idx;
+                    bothSq[bothCount++] = s2;
+                } else {
+                    mapKK[idx][s2] = code++;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < bothCount; i++) {
+        mapKK[bothIdx[i]][bothSq[i]] = code++;
+    }
+
+    binomial[0][0] = 1;
+    for (int n = 1; n < 64; n++) {
+        for (int k = 0; k < TB_MAX_PIECES && k <= n; k++) {
+            binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0)
+                           + (k < n ? binomial[k][n - 1] : 0);
+        }
+    }
+
+    // mapPawns orders a2-h7 so the leading pawn (nearest the edge, lowest
+    // rank) has the highest value
+    int available = 47;
+    for (int leadCount = 1; leadCount < TB_MAX_PIECES - 1; leadCount++) {
+        for (int f = 0; f < 4; f++) {
+            uint64_t idx = 0;
+            for (int r = 1; r <= 6; r++) {
+                int sq = sq_index(r, f);
+                if (leadCount == 1) {
+                    mapPawns[sq] = available--;
+                    mapPawns[sq ^ 7] = available--;
+                }
+                leadPawnIdx[leadCount][sq] = idx;
+                idx += binomial[leadCount - 1][mapPawns[sq]];
+            }
+            leadPawnsSize[leadCount][f] = idx;
+        }
+    }
+    tablesInitialized = true;
+}
+
+// ---- table registry ----
+
+static TBHashEntry* hashSlot(U64 key) {
+    size_t i = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 51) & (TB_HASH_SIZE - 1);
+    while (tbHash[i].key && tbHash[i].key != key) {
+        i = (i + 1) & (TB_HASH_SIZE - 1);
+    }
+    return &tbHash[i];
+}
+
+static TBTable* lookupTable(U64 key, int type) {
+    TBHashEntry* e = hashSlot(key);
+    if (e->key != key) return NULL;
+    return type == TB_WDL ? e->wdl : e->dtz;
+}
+
+static void freeTable(TBTable* t) {
+    if (t->base) munmap(t->base, t->mapping);
+    for (int i = 0; i < 2; i++) {
+        for (int f = 0; f < 4; f++) {
+            free(t->items[i][f].base64);
+            free(t->items[i][f].symlen);
+        }
+    }
+    free(t);
+}
+
+// "KRPvKR" -> material keys with either side as white. Returns false on an
+// unrecognised name.
+static bool parseTableName(const char* name, TBTable* t) {
+    const char* v = strchr(name, 'v');
+    if (!v || name[0] != 'K' || v[1] != 'K') return false;
+
+    int counts[2][7] = {{0}};
+    int total = 0;
+    for (const char* p = name; *p; p++) {
+        if (p == v) continue;
+        int type = pieceTypeFromChar(*p);
+        if (!type) return false;
+        counts[p > v][type]++;
+        total++;
+    }
+    if (total > TB_MAX_PIECES || counts[0][KING] != 1 || counts[1][KING] != 1)
+        return false;
+
+    t->key = t->key2 = 0;
+    t->hasUniquePieces = false;
+    for (int type = PAWN; type <= KING; type++) {
+        t->key  |= (U64)counts[0][type] << (4 * type) | (U64)counts[1][type] << (4 * (type + 8));
+        t->key2 |= (U64)counts[1][type] << (4 * type) | (U64)counts[0][type] << (4 * (type + 8));
+        if (type != KING && (counts[0][type] == 1 || counts[1][type] == 1))
+            t->hasUniquePieces = true;
+    }
+    t->pieceCount = total;
+    t->hasPawns = counts[0][PAWN] || counts[1][PAWN];
+
+    // leading color: the side with fewer (but some) pawns compresses better
+    bool whiteLeads = !counts[1][PAWN] || (counts[0][PAWN] && counts[1][PAWN] >= counts[0][PAWN]);
+    t->pawnCount[0] = (uint8_t)counts[whiteLeads ? 0 : 1][PAWN];
+    t->pawnCount[1] = (uint8_t)counts[whiteLeads ? 1 : 0][PAWN];
+
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    return true;
+}
+
+static void addTable(const char* name) {
+    TBTable probe;
+    memset(&probe, 0, sizeof(probe));
+    if (!parseTableName(name, &probe)) return;
+    if (lookupTable(probe.key, TB_WDL)) return;   // already found in an earlier directory
+
+    TBTable* wdl = (TBTable*) calloc(1, sizeof(TBTable));
+    TBTable* dtz = (TBTable*) calloc(1, sizeof(TBTable));
+    TBTable** grown = (TBTable**) realloc(tbTables, (tbTableCount + 2) * sizeof(TBTable*));
+    if (!wdl || !dtz || !grown) {
+        free(wdl);
+        free(dtz);
+        if (grown) tbTables = grown;
+        return;
+    }
+    tbTables = grown;
+
+    *wdl = probe;
+    wdl->type = TB_WDL;
+    *dtz = probe;
+    dtz->type = TB_DTZ;
+    tbTables[tbTableCount++] = wdl;
+    tbTables[tbTableCount++] = dtz;
+
+    U64 keys[2] = { probe.key, probe.key2 };
+    for (int i = 0; i < 2; i++) {
+        TBHashEntry* e = hashSlot(keys[i]);
+        e->key = keys[i];
+        e->wdl = wdl;
+        e->dtz = dtz;
+    }
+    if (probe.pieceCount > tbLargest)
+        tbLargest = probe.pieceCount;
+}
+
+void tbFree(void) {
+    for (int i = 0; i < tbTableCount; i++) {
+        freeTable(tbTables[i]);
+    }
+    free(tbTables);
+    tbTables = NULL;
+    tbTableCount = 0;
+    for (int i = 0; i < tbPathCount; i++) {
+        free(tbPaths[i]);
+    }
+    tbPathCount = 0;
+    tbLargest = 0;
+    memset(tbHash, 0, sizeof(tbHash));
+}
+
+int tbInit(const char* paths) {
+    tbFree();
+    if (!tablesInitialized)
+        initEncodingTables();
+
+    if (!paths || !*paths || !strcmp(paths, "<empty>"))
+        return 0;
+
+    const char* p = paths;
+    while (*p && tbPathCount < TB_MAX_PATHS) {
+        const char* end = strchr(p, ':');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len > 0) {
+            tbPaths[tbPathCount] = strndup(p, len);
+            if (tbPaths[tbPathCount]) tbPathCount++;
+        }
+        if (!end) break;
+        p = end + 1;
+    }
+
+    for (int i = 0; i < tbPathCount; i++) {
+        DIR* dir = opendir(tbPaths[i]);
+        if (!dir) continue;
+
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != NULL) {
+            size_t len = strlen(ent->d_name);
+            char name[16];
+            if (len < 6 || len - 5 >= sizeof(name) || strcmp(ent->d_name + len - 5, ".rtbw"))
+                continue;
+            memcpy(name, ent->d_name, len - 5);
+            name[len - 5] = '\0';
+            addTable(name);
+        }
+        closedir(dir);
+    }
+    return tbTableCount / 2;
+}
+
+// ---- file layout ----
+
+static PairsData* tablePairs(TBTable* t, int stm, int file) {
+    return &t->items[t->type == TB_WDL ? stm : 0][t->hasPawns ? file : 0];
+}
+
+/*
+ * Groups are runs of pieces encoded together: the leading group (lead pawns,
+ * or three unique pieces, or the two kings), then runs of identical pieces.
+ * order[] gives the position of the leading group and of the remaining pawns
+ * in the mixed-radix index.
+ */
+static void setGroups(TBTable* t, PairsData* d, const int order[2], int file) {
+    int n = 0;
+    int firstLen = t->hasPawns ? 0 : t->hasUniquePieces ? 3 : 2;
+    d->groupLen[n] = 1;
+
+    for (int i = 1; i < t->pieceCount; i++) {
+        if (--firstLen > 0 || d->pieces[i] == d->pieces[i - 1])
+            d->groupLen[n]++;
+        else
+            d->groupLen[++n] = 1;
+    }
+    d->groupLen[++n] = 0;
+
+    bool pp = t->hasPawns && t->pawnCount[1];
+    int next = pp ? 2 : 1;
+    int freeSquares = 64 - d->groupLen[0] - (pp ? d->groupLen[1] : 0);
+    uint64_t idx = 1;
+
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k++) {
+        if (k == order[0]) {
+            d->groupIdx[0] = idx;
+            idx *= t->hasPawns ? leadPawnsSize[d->groupLen[0]][file]
+                 : t->hasUniquePieces ? 31332 : 462;
+        } else if (k == order[1]) {
+            d->groupIdx[1] = idx;
+            idx *= binomial[d->groupLen[1]][48 - d->groupLen[0]];
+        } else {
+            d->groupIdx[next] = idx;
+            idx *= binomial[d->groupLen[next]][freeSquares];
+            freeSquares -= d->groupLen[next++];
+        }
+    }
+    d->groupIdx[n] = idx;
+}
+
+static uint8_t setSymlen(PairsData* d, Sym s, uint8_t* visited) {
+    visited[s] = 1;
+    Sym right = pairRight(&d->btree[s]);
+    if (right == 0xFFF)
+        return 0;
+
+    Sym left = pairLeft(&d->btree[s]);
+    if (!visited[left])
+        d->symlen[left] = setSymlen(d, left, visited);
+    if (!visited[right])
+        d->symlen[right] = setSymlen(d, right, visited);
+
+    return (uint8_t)(d->symlen[left] + d->symlen[right] + 1);
+}
+
+static const uint8_t* setSizes(PairsData* d, const uint8_t* data) {
+    d->flags = *data++;
+
+    if (d->flags & TB_FLAG_SINGLE_VALUE) {
+        d->numBlocks = 0;
+        d->span = 0;
+        d->blockLengthSize = 0;
+        d->sparseIndexSize = 0;
+        d->minSymLen = *data++;     // the single stored value
+        return data;
+    }
+
+    int groups = 0;
+    while (d->groupLen[groups]) groups++;
+    uint64_t tbSize = d->groupIdx[groups];
+
+    d->blockSize = (size_t)1 << *data++;
+    d->span = (size_t)1 << *data++;
+    d->sparseIndexSize = (size_t)((tbSize + d->span - 1) / d->span);
+    int padding = *data++;
+    d->numBlocks = readLE32(data);
+    data += 4;
+    d->blockLengthSize = d->numBlocks + padding;
+    d->maxSymLen = *data++;
+    d->minSymLen = *data++;
+    d->lowestSym = data;
+
+    // canonical Huffman: longer codes have lower values, so the lowest code
+    // of each length, left-aligned to 64 bits, decreases with the length
+    int lengths = d->maxSymLen - d->minSymLen + 1;
+    d->base64 = (uint64_t*) calloc(lengths, sizeof(uint64_t));
+    for (int i = lengths - 2; i >= 0; i--) {
+        d->base64[i] = (d->base64[i + 1] + readLE16(d->lowestSym + 2 * i)
+                        - readLE16(d->lowestSym + 2 * (i + 1))) / 2;
+    }
+    for (int i = 0; i < lengths; i++) {
+        d->base64[i] <<= 64 - i - d->minSymLen;
+    }
+
+    data += lengths * sizeof(Sym);
+    d->symCount = readLE16(data);
+    data += 2;
+    d->btree = (const SymPair*) data;
+
+    // each symbol is either a value or a pair of earlier symbols
+    d->symlen = (uint8_t*) calloc(d->symCount, 1);
+    uint8_t* visited = (uint8_t*) calloc(d->symCount, 1);
+    for (int s = 0; s < d->symCount; s++) {
+        if (!visited[s])
+            d->symlen[s] = setSymlen(d, (Sym)s, visited);
+    }
+    free(visited);
+
+    return data + d->symCount * sizeof(SymPair) + (d->symCount & 1);
+}
+
+static const uint8_t* setDtzMap(TBTable* t, const uint8_t* data, int maxFile) {
+    t->map = data;
+
+    for (int f = 0; f <= maxFile; f++) {
+        PairsData* d = tablePairs(t, 0, f);
+        if (!(d->flags & TB_FLAG_MAPPED))
+            continue;
+
+        if (d->flags & TB_FLAG_WIDE) {
+            data += (uintptr_t)data & 1;
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = (uint16_t)((data - t->map) / 2 + 1);
+                data += 2 * readLE16(data) + 2;
+            }
+        } else {
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = (uint16_t)(data - t->map + 1);
+                data += *data + 1;
+            }
+        }
+    }
+    return data + ((uintptr_t)data & 1);
+}
+
+static void setupTable(TBTable* t, const uint8_t* data) {
+    data++;     // split / has-pawns flags, already known from the file name
+
+    int sides = t->type == TB_WDL && t->key != t->key2 ? 2 : 1;
+    int maxFile = t->hasPawns ? 3 : 0;
+    bool pp = t->hasPawns && t->pawnCount[1];
+
+    for (int f = 0; f <= maxFile; f++) {
+        int order[2][2] = {
+            { *data & 0xF, pp ? data[1] & 0xF : 0xF },
+            { *data >> 4,  pp ? data[1] >> 4  : 0xF }
+        };
+        data += 1 + pp;
+
+        for (int k = 0; k < t->pieceCount; k++, data++) {
+            for (int i = 0; i < sides; i++) {
+                tablePairs(t, i, f)->pieces[k] = (uint8_t)(i ? *data >> 4 : *data & 0xF);
+            }
+        }
+        for (int i = 0; i < sides; i++) {
+            setGroups(t, tablePairs(t, i, f), order[i], f);
+        }
+    }
+    data += (uintptr_t)data & 1;
+
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++) {
+            data = setSizes(tablePairs(t, i, f), data);
+        }
+    }
+
+    if (t->type == TB_DTZ)
+        data = setDtzMap(t, data, maxFile);
+
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++) {
+            PairsData* d = tablePairs(t, i, f);
+            d->sparseIndex = data;
+            data += d->sparseIndexSize * 6;
+        }
+    }
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++) {
+            PairsData* d = tablePairs(t, i, f);
+            d->blockLength = data;
+            data += d->blockLengthSize * sizeof(uint16_t);
+        }
+    }
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++) {
+            PairsData* d = tablePairs(t, i, f);
+            data = (const uint8_t*)(((uintptr_t)data + 0x3F) & ~(uintptr_t)0x3F);
+            d->data = data;
+            data += (size_t)d->numBlocks * d->blockSize;
+        }
+    }
+}
+
+static void* mapFile(TBTable* t) {
+    static const uint8_t magics[2][4] = {
+        { 0x71, 0xE8, 0x23, 0x5D },     // WDL
+        { 0xD7, 0x66, 0x0C, 0xA5 }      // DTZ
+    };
+    const char* ext = t->type == TB_WDL ? ".rtbw" : ".rtbz";
+
+    for (int i = 0; i < tbPathCount; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s%s", tbPaths[i], t->name, ext);
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) continue;
+
+        struct stat st;
+        if (fstat(fd, &st) || st.st_size < 16) {
+            close(fd);
+            continue;
+        }
+        void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) continue;
+        madvise(base, (size_t)st.st_size, MADV_RANDOM);
+
+        if (memcmp(base, magics[t->type], 4)) {
+            fprintf(stderr, "info string corrupted table %s\n", path);
+            munmap(base, (size_t)st.st_size);
+            continue;
+        }
+        t->base = base;
+        t->mapping = (size_t)st.st_size;
+        setupTable(t, (const uint8_t*)base + 4);
+        return base;
+    }
+    return NULL;
+}
+
+// Maps the file on first use. Safe to call from several search threads.
+static bool tableMapped(TBTable* t) {
+    if (__atomic_load_n(&t->ready, __ATOMIC_ACQUIRE))
+        return t->base != NULL;
+
+    pthread_mutex_lock(&tbMapMutex);
+    if (!t->ready) {
+        mapFile(t);
+        __atomic_store_n(&t->ready, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&tbMapMutex);
+    return t->base != NULL;
+}
+
+// ---- decoding ----
+
+static int decompressPairs(PairsData* d, uint64_t idx) {
+    if (d->flags & TB_FLAG_SINGLE_VALUE)
+        return d->minSymLen;
+
+    // the sparse entry nearest to idx, then walk blockLength[] to the block
+    // holding it
+    uint32_t k = (uint32_t)(idx / d->span);
+    uint32_t block = readLE32(d->sparseIndex + 6 * (size_t)k);
+    int offset = readLE16(d->sparseIndex + 6 * (size_t)k + 4);
+    offset += (int)(idx % d->span) - (int)(d->span / 2);
+
+    while (offset < 0) {
+        offset += readLE16(d->blockLength + 2 * (size_t)--block) + 1;
+    }
+    while (offset > readLE16(d->blockLength + 2 * (size_t)block)) {
+        offset -= readLE16(d->blockLength + 2 * (size_t)block++) + 1;
+    }
+
+    const uint8_t* ptr = d->data + (size_t)block * d->blockSize;
+    uint64_t buf64 = readBE64(ptr);
+    ptr += 8;
+    int buf64Size = 64;
+    Sym sym;
+
+    for (;;) {
+        int len = 0;
+        while (buf64 < d->base64[len]) {
+            len++;
+        }
+        sym = (Sym)((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
+        sym = (Sym)(sym + readLE16(d->lowestSym + 2 * len));
+
+        if (offset < d->symlen[sym] + 1)
+            break;
+
+        offset -= d->symlen[sym] + 1;
+        len += d->minSymLen;
+        buf64 <<= len;
+        buf64Size -= len;
+
+        if (buf64Size <= 32) {
+            buf64Size += 32;
+            buf64 |= (uint64_t)readBE32(ptr) << (64 - buf64Size);
+            ptr += 4;
+        }
+    }
+
+    // expand the pair tree down to the leaf holding our value
+    while (d->symlen[sym]) {
+        Sym left = pairLeft(&d->btree[sym]);
+        if (offset < d->symlen[left] + 1) {
+            sym = left;
+        } else {
+            offset -= d->symlen[left] + 1;
+            sym = pairRight(&d->btree[sym]);
+        }
+    }
+    return pairLeft(&d->btree[sym]);
+}
+
+static int mapScore(TBTable* t, int file, int value, int wdl) {
+    if (t->type == TB_WDL)
+        return value - 2;
+
+    static const int wdlMap[5] = { 1, 3, 0, 2, 0 };
+    PairsData* d = tablePairs(t, 0, file);
+
+    if (d->flags & TB_FLAG_MAPPED) {
+        int at = d->mapIdx[wdlMap[wdl + 2]] + value;
+        value = (d->flags & TB_FLAG_WIDE) ? readLE16(t->map + 2 * at) : t->map[at];
+    }
+
+    // DTZ is stored in moves unless the table says plies
+    if ((wdl == WDL_WIN && !(d->flags & TB_FLAG_WIN_PLIES))
+        || (wdl == WDL_LOSS && !(d->flags & TB_FLAG_LOSS_PLIES))
+        || wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS)
+        value *= 2;
+
+    return value + 1;
+}
+
+static int doProbeTable(const Board* b, TBTable* t, int wdl, int* result) {
+    int squares[TB_MAX_PIECES];
+    int pieces[TB_MAX_PIECES];
+    int size = 0, leadPawnsCnt = 0, tbFile = 0;
+    uint64_t idx;
+    U64 bb, leadPawns = 0;
+
+    // tables are stored with the stronger side as white (and only white to
+    // move for symmetric material); otherwise flip colors and ranks
+    bool symmetricBlackToMove = t->key == t->key2 && b->mover == BLACK;
+    bool blackStronger = materialKey(b) != t->key;
+    int flip = symmetricBlackToMove || blackStronger;
+    int flipColor = flip * 8;
+    int flipSquares = flip * 56;
+    int stm = flip ^ (b->mover == BLACK);
+
+    if (t->hasPawns) {
+        int pc = tablePairs(t, 0, 0)->pieces[0] ^ flipColor;
+        leadPawns = bb = pieceCodeBoard(b, pc);
+        while (bb) {
+            squares[size++] = pop_lsb(&bb) ^ flipSquares;
+        }
+        leadPawnsCnt = size;
+
+        int lead = 0;
+        for (int i = 1; i < leadPawnsCnt; i++) {
+            if (mapPawns[squares[i]] > mapPawns[squares[lead]])
+                lead = i;
+        }
+        int tmp = squares[0]; squares[0] = squares[lead]; squares[lead] = tmp;
+
+        tbFile = edgeDistance(fileOf(squares[0]));
+    }
+
+    // DTZ tables hold one side to move only
+    if (t->type == TB_DTZ) {
+        int flags = tablePairs(t, stm, tbFile)->flags;
+        if ((flags & TB_FLAG_STM) != stm && !(t->key == t->key2 && !t->hasPawns)) {
+            *result = PROBE_CHANGE_STM;
+            return 0;
+        }
+    }
+
+    bb = b->occupied ^ leadPawns;
+    while (bb) {
+        int s = pop_lsb(&bb);
+        squares[size] = s ^ flipSquares;
+        pieces[size++] = pieceAt(b, s) ^ flipColor;
+    }
+
+    PairsData* d = tablePairs(t, stm, tbFile);
+
+    // reorder to the piece sequence the table was encoded with
+    for (int i = leadPawnsCnt; i < size - 1; i++) {
+        for (int j = i + 1; j < size; j++) {
+            if (d->pieces[i] == pieces[j]) {
+                int tp = pieces[i]; pieces[i] = pieces[j]; pieces[j] = tp;
+                int ts = squares[i]; squares[i] = squares[j]; squares[j] = ts;
+                break;
+            }
+        }
+    }
+
+    if (fileOf(squares[0]) > 3) {
+        for (int i = 0; i < size; i++) squares[i] ^= 7;
+    }
+
+    if (t->hasPawns) {
+        idx = leadPawnIdx[leadPawnsCnt][squares[0]];
+
+        // remaining lead pawns in ascending mapPawns order (stable)
+        for (int i = 2; i < leadPawnsCnt; i++) {
+            int s = squares[i], j = i - 1;
+            while (j >= 1 && mapPawns[squares[j]] > mapPawns[s]) {
+                squares[j + 1] = squares[j];
+                j--;
+            }
+            squares[j + 1] = s;
+        }
+        for (int i = 1; i < leadPawnsCnt; i++) {
+            idx += binomial[i][mapPawns[squares[i]]];
+        }
+    } else {
+        if (rankOf(squares[0]) > 3) {
+            for (int i = 0; i < size; i++) squares[i] ^= 56;
+        }
+
+        // first leading piece off the a1-h8 diagonal goes below it
+        for (int i = 0; i < d->groupLen[0]; i++) {
+            if (!offA1H8(squares[i]))
+                continue;
+            if (offA1H8(squares[i]) > 0) {
+                for (int j = i; j < size; j++) {
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+                }
+            }
+            break;
+        }
+
+        if (t->hasUniquePieces) {
+            int adjust1 = squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+            if (offA1H8(squares[0]))
+                idx = ((uint64_t)mapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62
+                      + squares[2] - adjust2;
+            else if (offA1H8(squares[1]))
+                idx = ((uint64_t)6 * 63 + rankOf(squares[0]) * 28 + mapB1H1H7[squares[1]]) * 62
+                      + squares[2] - adjust2;
+            else if (offA1H8(squares[2]))
+                idx = 6 * 63 * 62 + 4 * 28 * 62
+                      + rankOf(squares[0]) * 7 * 28
+                      + (rankOf(squares[1]) - adjust1) * 28
+                      + mapB1H1H7[squares[2]];
+            else
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28
+                      + rankOf(squares[0]) * 7 * 6
+                      + (rankOf(squares[1]) - adjust1) * 6
+                      + (rankOf(squares[2]) - adjust2);
+        } else {
+            idx = mapKK[mapA1D1D4[squares[0]]][squares[1]];
+        }
+    }
+
+    // remaining groups: ascending squares, each skipping the squares already
+    // taken by earlier groups
+    idx *= d->groupIdx[0];
+    int* groupSq = squares + d->groupLen[0];
+    bool remainingPawns = t->hasPawns && t->pawnCount[1];
+
+    for (int next = 1; d->groupLen[next]; next++) {
+        int len = d->groupLen[next];
+        for (int i = 1; i < len; i++) {
+            int s = groupSq[i], j = i - 1;
+            while (j >= 0 && groupSq[j] > s) {
+                groupSq[j + 1] = groupSq[j];
+                j--;
+            }
+            groupSq[j + 1] = s;
+        }
+
+        uint64_t n = 0;
+        for (int i = 0; i < len; i++) {
+            int adjust = 0;
+            for (const int* s = squares; s < groupSq; s++) {
+                adjust += groupSq[i] > *s;
+            }
+            n += binomial[i + 1][groupSq[i] - adjust - 8 * remainingPawns];
+        }
+        remainingPawns = false;
+        idx += n * d->groupIdx[next];
+        groupSq += len;
+    }
+
+    return mapScore(t, tbFile, decompressPairs(d, idx), wdl);
+}
+
+static int probeTable(const Board* b, int type, int wdl, int* result) {
+    if (__builtin_popcountll(b->occupied) == 2)
+        return WDL_DRAW;    // KvK
+
+    TBTable* t = lookupTable(materialKey(b), type);
+    if (!t || !tableMapped(t)) {
+        *result = PROBE_FAIL;
+        return 0;
+    }
+    return doProbeTable(b, t, wdl, result);
+}
+
+// ---- probing ----
+
+static int dtzBeforeZeroing(int wdl) {
+    return wdl == WDL_WIN          ?  1
+         : wdl == WDL_CURSED_WIN   ?  101
+         : wdl == WDL_BLESSED_LOSS ? -101
+         : wdl == WDL_LOSS         ? -1 : 0;
+}
+
+/*
+ * Tables store "don't care" values where a capture (or, for DTZ, a pawn
+ * move) decides the result, so resolve those moves first and take the
+ * better of them and the stored value.
+ */
+static int probeSearch(Board* b, bool checkZeroing, int* result) {
+    Move moves[256];
+    uint64_t total = 0;
+    generateLegalMovesToArray(b, moves, &total, 256);
+
+    int bestValue = WDL_LOSS, value;
+    uint64_t moveCount = 0;
+
+    for (uint64_t i = 0; i < total; i++) {
+        if (!isCapture(b, moves[i])
+            && (!checkZeroing || (pieceAt(b, moves[i].from) & 7) != PAWN))
+            continue;
+
+        moveCount++;
+
+        Undo u;
+        applyMove(b, moves[i], &u);
+        value = -probeSearch(b, false, result);
+        unmakeMove(b, &u);
+
+        if (*result == PROBE_FAIL)
+            return WDL_DRAW;
+
+        if (value > bestValue) {
+            bestValue = value;
+            if (value >= WDL_WIN) {
+                *result = PROBE_ZEROING;
+                return value;
+            }
+        }
+    }
+
+    bool noMoreMoves = moveCount && moveCount == total;
+    if (noMoreMoves) {
+        value = bestValue;
+    } else {
+        value = probeTable(b, TB_WDL, WDL_DRAW, result);
+        if (*result == PROBE_FAIL)
+            return WDL_DRAW;
+    }
+
+    if (bestValue >= value) {
+        *result = bestValue > WDL_DRAW || noMoreMoves ? PROBE_ZEROING : PROBE_OK;
+        return bestValue;
+    }
+    *result = PROBE_OK;
+    return value;
+}
+
+int tbProbeWDL(Board* b, int* success) {
+    int result = PROBE_OK;
+    int wdl = probeSearch(b, false, &result);
+    *success = result != PROBE_FAIL;
+    return wdl;
+}
+
+/*
+ * Distance to zeroing in plies, signed from the side to move:
+ *   n < -100  loss saved by the 50-move rule    -100 <= n < -1  loss
+ *   -1        mated                              0               draw
+ *   1 < n <= 100  win                            n > 100         win spoiled by the 50-move rule
+ * A value may be one ply short of the true distance.
+ */
+static int probeDTZ(Board* b, int* result) {
+    *result = PROBE_OK;
+    int wdl = probeSearch(b, true, result);
+
+    if (*result == PROBE_FAIL || wdl == WDL_DRAW)
+        return 0;
+
+    if (*result == PROBE_ZEROING)
+        return dtzBeforeZeroing(wdl);
+
+    int dtz = probeTable(b, TB_DTZ, wdl, result);
+    if (*result == PROBE_FAIL)
+        return 0;
+
+    if (*result != PROBE_CHANGE_STM)
+        return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) * signOf(wdl);
+
+    // the table stores the other side to move: take the best reply
+    Move moves[256];
+    uint64_t total = 0;
+    generateLegalMovesToArray(b, moves, &total, 256);
+
+    int minDTZ = 0xFFFF;
+    for (uint64_t i = 0; i < total; i++) {
+        bool zeroing = isCapture(b, moves[i]) || (pieceAt(b, moves[i].from) & 7) == PAWN;
+
+        Undo u;
+        applyMove(b, moves[i], &u);
+
+        if (zeroing) {
+            int r = PROBE_OK;
+            dtz = -dtzBeforeZeroing(probeSearch(b, false, &r));
+            *result = r;
+        } else {
+            dtz = -probeDTZ(b, result);
+        }
+
+        if (dtz == 1) {
+            // a mating move
+            AttackInfo ai;
+            Move replies[256];
+            uint64_t replyCount = 0;
+            computeAttackInfo(b, &ai);
+            generateLegalMovesWithAttacks(b, &ai, replies, &replyCount, 256);
+            if (ai.checkers && replyCount == 0)
+                minDTZ = 1;
+        }
+
+        if (!zeroing)
+            dtz += signOf(dtz);
+
+        if (dtz < minDTZ && signOf(dtz) == signOf(wdl))
+            minDTZ = dtz;
+
+        unmakeMove(b, &u);
+
+        if (*result == PROBE_FAIL)
+            return 0;
+    }
+    return minDTZ == 0xFFFF ? -1 : minDTZ;
+}
+
+int tbProbeDTZ(Board* b, int* success) {
+    int result;
+    int dtz = probeDTZ(b, &result);
+    *success = result != PROBE_FAIL;
+    return dtz;
+}
+
+static bool isMated(Board* b) {
+    AttackInfo ai;
+    Move replies[256];
+    uint64_t count = 0;
+    computeAttackInfo(b, &ai);
+    generateLegalMovesWithAttacks(b, &ai, replies, &count, 256);
+    return ai.checkers && count == 0;
+}
+
+static bool rankByDTZ(Board* b, const Move* moves, int count, int* ranks) {
+    int cnt50 = b->halfmoveClock;
+    bool rep = isRepetition(b);
+
+    for (int i = 0; i < count; i++) {
+        int result = PROBE_OK, dtz;
+        Undo u;
+        pushKeyHistory(b->key);
+        applyMove(b, moves[i], &u);
+
+        if (b->halfmoveClock == 0) {
+            int wdl = -probeSearch(b, false, &result);
+            dtz = dtzBeforeZeroing(wdl);
+        } else if (isRepetition(b) || b->halfmoveClock >= 100) {
+            dtz = 0;
+        } else {
+            dtz = -probeDTZ(b, &result);
+            dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : 0;
+        }
+
+        if (dtz == 2 && isMated(b))
+            dtz = 1;
+
+        unmakeMove(b, &u);
+        popKeyHistory();
+
+        if (result == PROBE_FAIL)
+            return false;
+
+        // certain wins rank equal; wins the 50-move rule may spoil rank by
+        // remaining margin, losses by how far the draw is
+        ranks[i] = dtz > 0 ? (dtz + cnt50 <= 99 && !rep ? TB_MAX_DTZ : TB_MAX_DTZ - (dtz + cnt50))
+                 : dtz < 0 ? (-dtz * 2 + cnt50 < 100 ? -TB_MAX_DTZ : -TB_MAX_DTZ + (-dtz + cnt50))
+                 : 0;
+    }
+    return true;
+}
+
+static bool rankByWDL(Board* b, const Move* moves, int count, int* ranks) {
+    static const int wdlToRank[5] = { -TB_MAX_DTZ, -TB_MAX_DTZ + 101, 0, TB_MAX_DTZ - 101, TB_MAX_DTZ };
+
+    for (int i = 0; i < count; i++) {
+        int result = PROBE_OK, wdl;
+        Undo u;
+        pushKeyHistory(b->key);
+        applyMove(b, moves[i], &u);
+
+        if (isRepetition(b) || b->halfmoveClock >= 100)
+            wdl = WDL_DRAW;
+        else
+            wdl = -probeSearch(b, false, &result);
+
+        unmakeMove(b, &u);
+        popKeyHistory();
+
+        if (result == PROBE_FAIL)
+            return false;
+        ranks[i] = wdlToRank[wdl + 2];
+    }
+    return true;
+}
+
+bool tbRankRootMoves(Board* b, const Move* moves, int count, int* ranks, bool* usedDTZ) {
+    *usedDTZ = false;
+    if (!tbLargest || hasCastlingRights(b) || __builtin_popcountll(b->occupied) > tbLargest)
+        return false;
+
+    if (rankByDTZ(b, moves, count, ranks)) {
+        *usedDTZ = true;
+        return true;
+    }
+    return rankByWDL(b, moves, count, ranks);
+}
@@ -0,0 +1,48 @@
+#ifndef SYZYGY_H
+#define SYZYGY_H
+
+#include "bitboard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Syzygy endgame tablebase probing. Tables are found by scanning the
+ * directories of SyzygyPath (':' separated) for *.rtbw files; each file is
+ * memory-mapped on first access and never copied into RAM.
+ *
+ * Adapted from Stockfish's prober, GPL v3 or later: see syzygy.c. It is
+ * only linked with make SYZYGY=1; other builds get syzygy_stub.c, where
+ * tbInit() finds nothing and every probe fails.
+ *
+ * WDL values, from the side to move:
+ *   -2 loss, -1 loss saved by the 50-move rule, 0 draw,
+ *    1 win spoiled by the 50-move rule, 2 win.
+ */
+
+#define TB_MAX_PIECES 7
+
+/* largest number of pieces (kings included) covered by the loaded tables */
+extern int tbLargest;
+/* minimum remaining depth for in-search WDL probes (SyzygyProbeDepth) */
+extern int tbProbeDepth;
+
+int tbInit(const char* paths);          // returns the number of WDL tables found
+void tbFree(void);
+
+int tbProbeWDL(Board* b, int* success);
+int tbProbeDTZ(Board* b, int* success);
+
+/*
+ * Ranks root moves by DTZ (falling back to WDL when DTZ files are missing):
+ * higher is better, equal ranks are equivalent. Returns false if any probe
+ * failed. *usedDTZ tells which table kind produced the ranking.
+ */
+bool tbRankRootMoves(Board* b, const Move* moves, int count, int* ranks, bool* usedDTZ);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SYZYGY_H */
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "syzygy.h"
+
+// ----------------- Syzygy stubs -----------------
+// Linked instead of syzygy.c unless the engine is built with make SYZYGY=1:
+// no tables are ever loaded, so every probe fails and the search never
+// consults them.
+
+int tbLargest = 0;
+int tbProbeDepth = 1;
+
+int tbInit(const char* paths) {
+    if (paths && *paths && strcmp(paths, "<empty>")) {
+        printf("info string Syzygy probing not compiled in, rebuild with make SYZYGY=1\n");
+        fflush(stdout);
+    }
+    return 0;
+}
+
+void tbFree(void) {}
+
+int tbProbeWDL(Board* b, int* success) {
+    (void)b;
+    *success = 0;
+    return 0;
+}
+
+int tbProbeDTZ(Board* b, int* success) {
+    (void)b;
+    *success = 0;
+    return 0;
+}
+
+bool tbRankRootMoves(Board* b, const Move* moves, int count, int* ranks, bool* usedDTZ) {
+    (void)b; (void)moves; (void)count; (void)ranks;
+    *usedDTZ = false;
+    return false;
+}
@@ -0,0 +1,238 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+// ----------------- Search trace -----------------
+
+#ifdef SEARCH_TRACE
+
+#define TRACE_RING_BITS 20      // 24 MB of records in flight
+
+_Thread_local bool traceActive = false;
+_Thread_local TraceNode traceNodes[MAX_DEPTH + 2];
+
+static TraceRecord* ring = NULL;
+static const size_t ringSize = (size_t)1 << TRACE_RING_BITS;
+static _Atomic size_t ringHead;         // written by the searching thread only
+static _Atomic size_t ringTail;         // written by the writer thread only
+static _Atomic uint64_t ringDropped;
+static _Atomic bool writerStop;
+static pthread_t writerThread;
+static FILE* traceFile = NULL;
+static uint64_t recordsWritten;
+
+static void* traceWriter(void* arg) {
+    (void)arg;
+    const struct timespec idle = { 0, 1000000 };
+
+    for (;;) {
+        // read the flag first: once it is set no more records are coming
+        bool stop = atomic_load(&writerStop);
+        size_t tail = atomic_load_explicit(&ringTail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ringHead, memory_order_acquire);
+
+        if (head == tail) {
+            if (stop) break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        size_t start = tail & (ringSize - 1);
+        size_t n = head - tail;
+        if (start + n > ringSize) n = ringSize - start;
+        fwrite(ring + start, sizeof(TraceRecord), n, traceFile);
+        recordsWritten += n;
+        atomic_store_explicit(&ringTail, tail + n, memory_order_release);
+    }
+    return NULL;
+}
+
+bool traceStart(const char* path) {
+    traceStop();
+
+    traceFile = fopen(path, "wb");
+    if (!traceFile) {
+        printf("info string cannot open trace file %s\n", path);
+        fflush(stdout);
+        return false;
+    }
+    ring = (TraceRecord*) malloc(ringSize * sizeof(TraceRecord));
+    if (!ring) {
+        fclose(traceFile);
+        traceFile = NULL;
+        return false;
+    }
+
+    unsigned char header[12] = { 'C', 'T', 'R', 'C' };
+    unsigned words[2] = { TRACE_VERSION, (unsigned)sizeof(TraceRecord) };
+    for (int w = 0; w < 2; w++) {
+        for (int k = 0; k < 4; k++) header[4 + w * 4 + k] = (unsigned char)(words[w] >> (8 * k));
+    }
+    fwrite(header, 1, sizeof(header), traceFile);
+
+    atomic_store(&ringHead, 0);
+    atomic_store(&ringTail, 0);
+    atomic_store(&ringDropped, 0);
+    atomic_store(&writerStop, false);
+    recordsWritten = 0;
+
+    if (pthread_create(&writerThread, NULL, traceWriter, NULL) != 0) {
+        free(ring);
+        ring = NULL;
+        fclose(traceFile);
+        traceFile = NULL;
+        return false;
+    }
+    return true;
+}
+void traceStop(void) {
+    if (!traceFile)
+        return;
+
+    atomic_store(&writerStop, true);
+    pthread_join(writerThread, NULL);
+    fclose(traceFile);
+    traceFile = NULL;
+    free(ring);
+    ring = NULL;
+    traceActive = false;
+
+    printf("info string trace wrote %llu records, dropped %llu\n",
+           (unsigned long long)recordsWritten, (unsigned long long)atomic_load(&ringDropped));
+    fflush(stdout);
+}
+
+// Only one non-silent search runs at a time, so the ring has one producer.
+void traceBeginSearch(bool silent) {
+    traceActive = traceFile != NULL && !silent;
+}
+void tracePush(const TraceRecord* r) {
+    size_t head = atomic_load_explicit(&ringHead, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ringTail, memory_order_acquire);
+    if (head - tail >= ringSize) {
+        atomic_fetch_add_explicit(&ringDropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring[head & (ringSize - 1)] = *r;
+    atomic_store_explicit(&ringHead, head + 1, memory_order_release);
+}
+
+#else
+
+bool traceStart(const char* path) {
+    (void)path;
+    printf("info string trace not compiled in, rebuild with make TRACE=1\n");
+    fflush(stdout);
+    return false;
+}
+void traceStop(void) {}
+
+#endif
+
+// ----------------- Trace analyzer -----------------
+
+#define CUTOFF_BUCKETS 6        // first, second, third, fourth, 5-8, later
+
+typedef struct {
+    uint64_t nodes;
+    uint64_t results[TRACE_RESULT_COUNT];
+    uint64_t cutoffAt[CUTOFF_BUCKETS];
+    uint64_t cutoffIndexSum;
+    uint64_t moveSum;           // legal moves over nodes that generated them
+    uint64_t expanded;
+    uint64_t subtreeSum;
+    uint32_t subtreeMax;
+} DepthSummary;
+
+static int cutoffBucket(int index) {
+    return index < 4 ? index : (index < 8 ? 4 : 5);
+}
+
+int runTraceAnalyze(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: chess traceanalyze <file>\n");
+        return 1;
+    }
+    FILE* f = fopen(argv[2], "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", argv[2]);
+        return 1;
+    }
+
+    unsigned char header[12];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, TRACE_MAGIC, 4)
+        || header[4] != TRACE_VERSION || header[8] != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s is not a version %d search trace\n", argv[2], TRACE_VERSION);
+        fclose(f);
+        return 1;
+    }
+
+    static DepthSummary depths[MAX_DEPTH + 1];
+    memset(depths, 0, sizeof(depths));
+    uint64_t total = 0;
+    TraceRecord buf[4096];
+    size_t n;
+
+    while ((n = fread(buf, sizeof(TraceRecord), 4096, f)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            const TraceRecord* r = &buf[i];
+            int d = r->depth < 0 ? 0 : (r->depth > MAX_DEPTH ? MAX_DEPTH : r->depth);
+            DepthSummary* s = &depths[d];
+
+            s->nodes++;
+            s->results[r->result < TRACE_RESULT_COUNT ? r->result : TRACE_EXACT]++;
+            if (r->result == TRACE_FAIL_HIGH && r->cutoffIndex != 255) {
+                s->cutoffAt[cutoffBucket(r->cutoffIndex)]++;
+                s->cutoffIndexSum += r->cutoffIndex;
+            }
+            if (r->moveCount) {
+                s->moveSum += r->moveCount;
+                s->expanded++;
+            }
+            s->subtreeSum += r->nodes;
+            if (r->nodes > s->subtreeMax) s->subtreeMax = r->nodes;
+        }
+        total += n;
+    }
+    fclose(f);
+
+    printf("%llu nodes\n\n", (unsigned long long)total);
+    printf("depth      nodes  failhigh  1st%%  2nd%%  3rd%%  4th%%  5-8%%  9+%%  avgidx  faillow  exact    tt  moves  avgsub   maxsub\n");
+    for (int d = MAX_DEPTH; d >= 0; d--) {
+        const DepthSummary* s = &depths[d];
+        if (!s->nodes) continue;
+
+        uint64_t fh = s->results[TRACE_FAIL_HIGH];
+        uint64_t indexed = 0;
+        for (int b = 0; b < CUTOFF_BUCKETS; b++) indexed += s->cutoffAt[b];
+
+        printf("%5d %10llu %9llu", d, (unsigned long long)s->nodes, (unsigned long long)fh);
+        for (int b = 0; b < CUTOFF_BUCKETS; b++) {
+            printf(" %5.1f", indexed ? 100.0 * s->cutoffAt[b] / indexed : 0.0);
+        }
+        printf(" %7.2f %8llu %6llu %5llu %6.1f %7.0f %8u\n",
+               indexed ? (double)s->cutoffIndexSum / indexed : 0.0,
+               (unsigned long long)s->results[TRACE_FAIL_LOW],
+               (unsigned long long)s->results[TRACE_EXACT],
+               (unsigned long long)s->results[TRACE_TT_CUTOFF],
+               s->expanded ? (double)s->moveSum / s->expanded : 0.0,
+               (double)s->subtreeSum / s->nodes, s->subtreeMax);
+    }
+
+    static const char* names[TRACE_RESULT_COUNT] = {
+        "exact", "failhigh", "faillow", "tt", "tablebase", "draw", "mate", "qsearch", "stopped"
+    };
+    printf("\nresults:");
+    for (int k = 0; k < TRACE_RESULT_COUNT; k++) {
+        uint64_t c = 0;
+        for (int d = 0; d <= MAX_DEPTH; d++) c += depths[d].results[k];
+        printf(" %s %llu", names[k], (unsigned long long)c);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "bitboard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Search-tree trace. With -DSEARCH_TRACE (make TRACE=1) every minimax()
+ * node of a non-silent search is recorded when it returns, so a file holds
+ * the tree in post-order. Records go through a single-producer ring buffer
+ * to a writer thread; when the writer falls behind, records are dropped
+ * and counted rather than stalling the search.
+ *
+ * File: the 4-byte magic "CTRC", a uint32 version and a uint32 record
+ * size, then TraceRecords back to back, all little-endian.
+ */
+
+#define TRACE_MAGIC "CTRC"
+#define TRACE_VERSION 1
+
+enum {
+    TRACE_EXACT,                // score inside the window
+    TRACE_FAIL_HIGH,            // a move reached beta, see cutoffIndex
+    TRACE_FAIL_LOW,
+    TRACE_TT_CUTOFF,
+    TRACE_TB_CUTOFF,
+    TRACE_DRAW,                 // repetition or 50-move rule
+    TRACE_MATE,                 // no legal moves: mate or stalemate
+    TRACE_QSEARCH,              // depth 0, handed to quiescence()
+    TRACE_STOPPED,
+    TRACE_RESULT_COUNT
+};
+
+typedef struct {
+    int32_t alpha;              // window on entry
+    int32_t beta;
+    int32_t score;              // returned score
+    uint32_t nodes;             // subtree size, quiescence included
+    uint16_t move;              // packMove() of the move leading here
+    uint8_t ply;
+    int8_t depth;
+    uint8_t result;             // TRACE_*
+    uint8_t cutoffIndex;        // fail-high move's index in ordering, 255 = none
+    uint8_t moveCount;          // legal moves (capped at 255), 0 if not generated
+    uint8_t reserved;
+} TraceRecord;
+
+_Static_assert(sizeof(TraceRecord) == 24, "TraceRecord must stay 24 bytes");
+
+/* start / stop streaming to a file; the writer is a background thread */
+bool traceStart(const char* path);
+void traceStop(void);
+
+/* "chess traceanalyze <file>" */
+int runTraceAnalyze(int argc, char** argv);
+
+#ifdef SEARCH_TRACE
+
+// Per-ply details the node body leaves for the record written on return.
+typedef struct {
+    uint16_t move;
+    uint8_t result;             // TRACE_RESULT_COUNT = decide from the score
+    uint8_t cutoffIndex;
+    uint8_t moveCount;
+} TraceNode;
+
+extern _Thread_local bool traceActive;
+extern _Thread_local TraceNode traceNodes[MAX_DEPTH + 2];
+void traceBeginSearch(bool silent);
+void tracePush(const TraceRecord* r);
+
+#define TRACE_SET(ply, field, value) (traceNodes[ply].field = (value))
+#else
+#define TRACE_SET(ply, field, value) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
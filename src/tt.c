@@ -0,0 +1,230 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+
+// ----------------- Transposition table -----------------
+
+#define TT_PAGE_SIZE ((size_t)2 << 20)          // x86-64 / arm64 huge page
+#define TT_CLEAR_CHUNK ((size_t)32 << 20)       // smallest slice worth a thread
+#define TT_CLEAR_MAX_THREADS 64
+
+static TTBucket* ttTable = NULL;
+static size_t ttBucketCount = 0;
+static size_t ttBytes = 0;
+static bool ttMapped = false;                   // MAP_HUGETLB mapping, else posix_memalign
+static uint8_t ttGeneration = 0;               // read and bumped atomically by searching threads
+
+/*
+ * Prefer explicit huge pages; they need pages reserved by the admin
+ * (vm.nr_hugepages), so fall back to 2 MB aligned memory and ask for
+ * transparent huge pages instead. Either way a multi-GB table needs a
+ * fraction of the TLB entries it would with 4 KB pages.
+ */
+static void* ttAlloc(size_t bytes) {
+    ttMapped = false;
+#ifdef MAP_HUGETLB
+    void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        ttMapped = true;
+        return p;
+    }
+#endif
+    void* mem = NULL;
+    if (posix_memalign(&mem, TT_PAGE_SIZE, bytes) != 0)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(mem, bytes, MADV_HUGEPAGE);
+#endif
+    return mem;
+}
+static void ttFree(void) {
+    if (ttMapped) {
+        munmap(ttTable, ttBytes);
+    } else {
+        free(ttTable);
+    }
+    ttTable = NULL;
+    ttBucketCount = ttBytes = 0;
+}
+
+typedef struct {
+    char* start;
+    size_t len;
+} ClearSlice;
+
+static void* clearSlice(void* arg) {
+    ClearSlice* s = (ClearSlice*)arg;
+    memset(s->start, 0, s->len);
+    return NULL;
+}
+// Zero the table with one thread per core, which also faults the pages in
+// from every core's memory controller rather than just the caller's.
+static void ttClearParallel(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = ttBytes / TT_CLEAR_CHUNK;
+    if (threads > (size_t)cpus) threads = (size_t)cpus;
+    if (threads > TT_CLEAR_MAX_THREADS) threads = TT_CLEAR_MAX_THREADS;
+
+    if (threads <= 1) {
+        memset(ttTable, 0, ttBytes);
+        return;
+    }
+
+    pthread_t workers[TT_CLEAR_MAX_THREADS];
+    bool spawned[TT_CLEAR_MAX_THREADS];
+    ClearSlice slices[TT_CLEAR_MAX_THREADS];
+    size_t per = (ttBytes / threads + TT_PAGE_SIZE - 1) & ~(TT_PAGE_SIZE - 1);
+
+    for (size_t i = 0; i < threads; i++) {
+        size_t offset = i * per;
+        slices[i].start = (char*)ttTable + offset;
+        slices[i].len = offset >= ttBytes ? 0 : (ttBytes - offset < per ? ttBytes - offset : per);
+        spawned[i] = pthread_create(&workers[i], NULL, clearSlice, &slices[i]) == 0;
+        if (!spawned[i]) {
+            clearSlice(&slices[i]);
+        }
+    }
+    for (size_t i = 0; i < threads; i++) {
+        if (spawned[i]) pthread_join(workers[i], NULL);
+    }
+}
+
+void ttResize(size_t megabytes) {
+    if (megabytes < 1) megabytes = 1;
+
+    ttFree();
+    size_t buckets = megabytes * 1024 * 1024 / sizeof(TTBucket);
+    size_t bytes = (buckets * sizeof(TTBucket) + TT_PAGE_SIZE - 1) & ~(TT_PAGE_SIZE - 1);
+    ttTable = (TTBucket*) ttAlloc(bytes);
+    if (ttTable) {
+        ttBucketCount = buckets;
+        ttBytes = bytes;
+        ttClearParallel();
+    }
+    __atomic_store_n(&ttGeneration, 0, __ATOMIC_RELAXED);
+}
+void ttClear(void) {
+    if (ttTable) {
+        ttClearParallel();
+    }
+    __atomic_store_n(&ttGeneration, 0, __ATOMIC_RELAXED);
+}
+void ttNewSearch(void) {
+    // generation lives in the upper 6 bits of boundAge; the low 2 stay clear
+    __atomic_fetch_add(&ttGeneration, 4, __ATOMIC_RELAXED);
+}
+
+static inline U64 ttPack(int score, uint16_t move, int depth, uint8_t boundAge) {
+    return (U64)(uint32_t)score | (U64)move << 32 | (U64)(uint8_t)depth << 48 | (U64)boundAge << 56;
+}
+static inline void ttUnpack(U64 key, U64 data, TTEntry* out) {
+    out->key = key;
+    out->score = (int32_t)(uint32_t)data;
+    out->move = (uint16_t)(data >> 32);
+    out->depth = (int8_t)(data >> 48);
+    out->boundAge = (uint8_t)(data >> 56);
+}
+static inline U64 ttLoad(const U64* word) {
+    return __atomic_load_n(word, __ATOMIC_RELAXED);
+}
+// Data first: until keyXorData follows, a reader sees a key mismatch.
+static inline void ttWrite(TTSlot* s, U64 key, U64 data) {
+    __atomic_store_n(&s->data, data, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->keyXorData, key ^ data, __ATOMIC_RELAXED);
+}
+
+static inline TTBucket* ttBucket(U64 key) {
+    // multiply-shift maps the key onto [0, ttBucketCount) without a modulo
+    return &ttTable[(size_t)(((unsigned __int128)key * ttBucketCount) >> 64)];
+}
+
+// Start loading the bucket of a position that will be probed shortly.
+void ttPrefetch(U64 key) {
+    if (ttTable) __builtin_prefetch(ttBucket(key));
+}
+
+bool ttProbe(U64 key, TTEntry* out) {
+    if (!ttTable) return false;
+
+    TTBucket* bucket = ttBucket(key);
+    uint8_t generation = __atomic_load_n(&ttGeneration, __ATOMIC_RELAXED);
+    for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+        TTSlot* s = &bucket->slots[i];
+        U64 data = ttLoad(&s->data);
+        uint8_t boundAge = (uint8_t)(data >> 56);
+        if ((ttLoad(&s->keyXorData) ^ data) == key && (boundAge & 3) != TT_NONE) {
+            if ((boundAge & 0xFC) != generation) {
+                data = (data & ~((U64)0xFF << 56)) | (U64)(generation | (boundAge & 3)) << 56;
+                ttWrite(s, key, data);
+            }
+            ttUnpack(key, data, out);
+            return true;
+        }
+    }
+    return false;
+}
+/*
+ * Replacement: reuse the slot already holding this key, otherwise evict the
+ * entry with the lowest depth, treating entries from older searches as
+ * shallower the older they are.
+ */
+void ttStore(U64 key, int depth, int score, int bound, Move best) {
+    if (!ttTable) return;
+
+    TTBucket* bucket = ttBucket(key);
+    uint8_t generation = __atomic_load_n(&ttGeneration, __ATOMIC_RELAXED);
+    TTSlot* replace = &bucket->slots[0];
+    TTEntry old = {0};
+    int worst = 1 << 30;
+
+    for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+        TTSlot* s = &bucket->slots[i];
+        U64 data = ttLoad(&s->data);
+        U64 slotKey = ttLoad(&s->keyXorData) ^ data;
+        TTEntry e;
+        ttUnpack(slotKey, data, &e);
+        if (slotKey == key || (e.boundAge & 3) == TT_NONE) {
+            replace = s;
+            old = e;
+            break;
+        }
+        int age = ((generation - (e.boundAge & 0xFC)) & 0xFF) >> 2;
+        int value = e.depth - 4 * age;
+        if (value < worst) {
+            worst = value;
+            replace = s;
+            old = e;
+        }
+    }
+
+    uint16_t packed = packMove(best);
+    if (!packed && old.key == key) {
+        packed = old.move;          // keep the old move on an upper-bound store
+    }
+
+    ttWrite(replace, key, ttPack(score, packed, depth, (uint8_t)(generation | bound)));
+}
+// Permille of sampled entries written during the current search.
+int ttHashfull(void) {
+    if (!ttTable) return 0;
+
+    size_t samples = 1000 / TT_BUCKET_SIZE;
+    if (samples > ttBucketCount) samples = ttBucketCount;
+
+    uint8_t generation = __atomic_load_n(&ttGeneration, __ATOMIC_RELAXED);
+    int used = 0;
+    for (size_t b = 0; b < samples; b++) {
+        for (int i = 0; i < TT_BUCKET_SIZE; i++) {
+            uint8_t boundAge = (uint8_t)(ttLoad(&ttTable[b].slots[i].data) >> 56);
+            if ((boundAge & 3) != TT_NONE && (boundAge & 0xFC) == generation) {
+                used++;
+            }
+        }
+    }
+    return samples ? (int)(used * 1000 / (samples * TT_BUCKET_SIZE)) : 0;
+}
@@ -0,0 +1,444 @@
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitboard.h"
+#include "gensfen.h"
+
+// ----------------- Texel tuning -----------------
+
+/*
+ * chess tune <data> [epochs N] [lr X] [threads N] [limit N] [out FILE]
+ *
+ * evaluate() is linear in its parameters once the phase is fixed, so each
+ * position is reduced to a sparse trace: for every EvalParams value it
+ * touches, how often it is added to the middlegame and to the endgame sum.
+ * The tuner then minimises
+ *
+ *     E = mean (result - sigmoid(K * eval / 400))^2
+ *
+ * over the traces with Adam, K being fitted first so the current values
+ * start at their own optimum. The traces reproduce evaluate() exactly,
+ * checked on every loaded position. The result is written as an EvalFile.
+ *
+ * <data> is a gensfen .bin file or text with one position per line: a FEN
+ * followed by the result as "1-0" / "0-1" / "1/2-1/2", [1.0] / [0.5] /
+ * [0.0], or a bare 1 / 0.5 / 0, always from white's point of view.
+ */
+
+#define TUNE_PARAMS EVAL_PARAM_COUNT
+#define PARAM(member) ((int)(offsetof(EvalParams, member) / sizeof(int)))
+
+// one parameter occurrence: eval += param * (mg * (MAX_PHASE - phase) + eg * phase) / MAX_PHASE
+typedef struct {
+    uint16_t index;
+    int8_t mg;
+    int8_t eg;
+} TraceEntry;
+
+typedef struct {
+    uint32_t offset;            // first TraceEntry in the pool
+    uint8_t count;
+    uint8_t phase;
+    uint8_t result;             // white's score in half points: 0, 1, 2
+} TunePosition;
+
+typedef struct {
+    TunePosition* positions;
+    size_t count, capacity;
+    TraceEntry* pool;
+    size_t poolCount, poolCapacity;
+    size_t mismatches;
+} TuneSet;
+
+// ----------------- Traces -----------------
+
+static void addTerm(int mg[], int eg[], int index, int mgCount, int egCount) {
+    mg[index] += mgCount;
+    eg[index] += egCount;
+}
+
+// kingSafetyMG(): back rank or exposed, and the shield pawns in front
+static void traceKing(int mg[], int eg[], const Board* b, int color, int sign) {
+    U64 king = (color == WHITE) ? b->wk : b->bk;
+    if (!king) return;
+    int sq = __builtin_ctzll(king);
+    int r = sq >> 3, f = sq & 7;
+
+    bool home = (color == WHITE && r <= 1) || (color == BLACK && r >= 6);
+    addTerm(mg, eg, home ? PARAM(kingBackRank) : PARAM(kingExposed), sign, 0);
+
+    int fr = r + ((color == WHITE) ? 1 : -1);
+    if (fr >= 0 && fr < 8) {
+        U64 pawns = (color == WHITE) ? b->wp : b->bp;
+        for (int df = -1; df <= 1; df++) {
+            int ff = f + df;
+            if (ff >= 0 && ff <= 7 && (pawns & bit(fr * 8 + ff)))
+                addTerm(mg, eg, PARAM(kingShieldPawn), sign, 0);
+        }
+    }
+}
+static int kingZoneAttacks(const Board* b, const AttackInfo* ai, int color) {
+    U64 king = (color == WHITE) ? b->wk : b->bk;
+    if (!king) return 0;
+    U64 zone = kingAttacks[__builtin_ctzll(king)] | king;
+    return __builtin_popcountll(zone & ai->attacked[colorIndex(color) ^ 1]);
+}
+static int hanging(const Board* b, const AttackInfo* ai, int color) {
+    int c = colorIndex(color);
+    U64 pieces = (color == WHITE) ? (b->wn | b->wb | b->wr | b->wq) : (b->bn | b->bb | b->br | b->bq);
+    return __builtin_popcountll(pieces & ai->attacked[c ^ 1] & ~ai->attacked[c]);
+}
+
+// Appends the trace of b; false if it does not fit the compact encoding.
+static bool tracePosition(TuneSet* set, Board* b, int result) {
+    int mg[TUNE_PARAMS], eg[TUNE_PARAMS];
+    memset(mg, 0, sizeof(mg));
+    memset(eg, 0, sizeof(eg));
+
+    AttackInfo ai;
+    computeAttackInfo(b, &ai);
+
+    // same lookups as evalPrepare()
+    U64 occ = b->occupied;
+    while (occ) {
+        int sq = pop_lsb(&occ);
+        int code = pieceAt(b, sq);
+        int piece = code & 7;
+        int sign = (code & COLOR_MASK) == WHITE ? 1 : -1;
+
+        int tableSq = sign > 0 ? sq : sq ^ 56;
+
+        if (piece != KING)
+            addTerm(mg, eg, PARAM(material[piece]), sign, sign);
+        addTerm(mg, eg, PARAM(pst[piece][MG][tableSq]), sign, 0);
+        addTerm(mg, eg, PARAM(pst[piece][EG][tableSq]), 0, sign);
+    }
+
+    int dp = doubledPawns(b, WHITE) - doubledPawns(b, BLACK);
+    int ip = isolatedPawns(b, WHITE) - isolatedPawns(b, BLACK);
+    int pp = passedPawns(b, WHITE) - passedPawns(b, BLACK);
+    addTerm(mg, eg, PARAM(doubledPawn), dp, dp);
+    addTerm(mg, eg, PARAM(isolatedPawn[MG]), ip, 0);
+    addTerm(mg, eg, PARAM(isolatedPawn[EG]), 0, ip);
+    addTerm(mg, eg, PARAM(passedPawn[MG]), pp, 0);
+    addTerm(mg, eg, PARAM(passedPawn[EG]), 0, pp);
+
+    traceKing(mg, eg, b, WHITE, 1);
+    traceKing(mg, eg, b, BLACK, -1);
+    addTerm(mg, eg, PARAM(kingZoneAttack), kingZoneAttacks(b, &ai, WHITE) - kingZoneAttacks(b, &ai, BLACK), 0);
+
+    int h = hanging(b, &ai, WHITE) - hanging(b, &ai, BLACK);
+    addTerm(mg, eg, PARAM(hangingPiece[MG]), h, 0);
+    addTerm(mg, eg, PARAM(hangingPiece[EG]), 0, h);
+
+    const int (*mob)[7] = ai.mobility;
+    for (int piece = KNIGHT; piece <= QUEEN; piece++) {
+        int d = mob[0][piece] - mob[1][piece];
+        addTerm(mg, eg, PARAM(mobility[piece][MG]), d, 0);
+        addTerm(mg, eg, PARAM(mobility[piece][EG]), 0, d);
+    }
+
+    int phase = computePhase(b);
+
+    // the trace must give back evaluate() to the centipawn
+    const int* values = (const int*)&evalParams;
+    long num = 0;
+    for (int i = 0; i < TUNE_PARAMS; i++) {
+        num += (long)values[i] * (mg[i] * (MAX_PHASE - phase) + eg[i] * phase);
+    }
+    int expected = evaluate(b);
+    if (b->mover == BLACK) expected = -expected;
+    if (num / MAX_PHASE != expected) {
+        set->mismatches++;
+        return false;
+    }
+
+    if (set->poolCount + TUNE_PARAMS > set->poolCapacity) {
+        set->poolCapacity = set->poolCapacity ? set->poolCapacity * 2 : (1u << 20);
+        set->pool = (TraceEntry*) realloc(set->pool, set->poolCapacity * sizeof(TraceEntry));
+    }
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : (1u << 16);
+        set->positions = (TunePosition*) realloc(set->positions, set->capacity * sizeof(TunePosition));
+    }
+
+    TunePosition* p = &set->positions[set->count];
+    p->offset = (uint32_t)set->poolCount;
+    p->count = 0;
+    for (int i = 0; i < TUNE_PARAMS; i++) {
+        if (!mg[i] && !eg[i])
+            continue;
+        if (mg[i] < -128 || mg[i] > 127 || eg[i] < -128 || eg[i] > 127 || p->count == 255)
+            return false;
+        TraceEntry* e = &set->pool[set->poolCount + p->count++];
+        e->index = (uint16_t)i;
+        e->mg = (int8_t)mg[i];
+        e->eg = (int8_t)eg[i];
+    }
+    p->phase = (uint8_t)phase;
+    p->result = (uint8_t)result;
+    set->poolCount += p->count;
+    set->count++;
+    return true;
+}
+
+// ----------------- Loading -----------------
+
+// White's result in half points from the text after the FEN, -1 if none.
+static int parseResultText(const char* s) {
+    const char* p;
+    if (strstr(s, "1/2-1/2") || strstr(s, "[0.5]")) return 1;
+    if (strstr(s, "1-0") || strstr(s, "[1.0]") || strstr(s, "[1]")) return 2;
+    if (strstr(s, "0-1") || strstr(s, "[0.0]") || strstr(s, "[0]")) return 0;
+
+    // bare number as the last token
+    p = s + strlen(s);
+    while (p > s && (p[-1] == ' ' || p[-1] == '\n' || p[-1] == '\r' || p[-1] == ';')) p--;
+    const char* end = p;
+    while (p > s && p[-1] != ' ') p--;
+    if (end - p == 3 && !strncmp(p, "0.5", 3)) return 1;
+    if (end - p == 1 && *p == '1') return 2;
+    if (end - p == 1 && *p == '0') return 0;
+    return -1;
+}
+
+static bool loadText(TuneSet* set, const char* path, size_t limit) {
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[1024];
+    while (set->count < limit && fgets(line, sizeof(line), f)) {
+        int result = parseResultText(line);
+        Board b;
+        if (result < 0 || !parseFEN(&b, line))
+            continue;
+        tracePosition(set, &b, result);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool loadPacked(TuneSet* set, const char* path, size_t limit) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || st.st_size < (off_t)sizeof(PackedPos)) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const PackedPos* recs = (const PackedPos*)data;
+    size_t total = (size_t)st.st_size / sizeof(PackedPos);
+    for (size_t i = 0; i < total && set->count < limit; i++) {
+        Board b;
+        unpackPosition(&recs[i], &b);
+        int result = recs[i].result;
+        if (b.mover == BLACK) result = -result;
+        tracePosition(set, &b, result + 1);
+    }
+    munmap(data, (size_t)st.st_size);
+    return true;
+}
+
+// ----------------- Optimisation -----------------
+
+typedef struct {
+    const TuneSet* set;
+    const double* params;
+    size_t begin, end;
+    double k;
+    bool wantGradient;
+    double error;
+    double gradient[TUNE_PARAMS];
+} TuneSlice;
+
+static inline double traceEval(const TuneSet* set, const TunePosition* p, const double* params) {
+    double mg = 0.0, eg = 0.0;
+    const TraceEntry* e = set->pool + p->offset;
+    for (int i = 0; i < p->count; i++) {
+        mg += params[e[i].index] * e[i].mg;
+        eg += params[e[i].index] * e[i].eg;
+    }
+    return (mg * (MAX_PHASE - p->phase) + eg * p->phase) / MAX_PHASE;
+}
+
+static void* tuneSlice(void* arg) {
+    TuneSlice* s = (TuneSlice*)arg;
+    const TuneSet* set = s->set;
+    const double scale = s->k * log(10.0) / 400.0;
+    s->error = 0.0;
+    if (s->wantGradient)
+        memset(s->gradient, 0, sizeof(s->gradient));
+
+    for (size_t n = s->begin; n < s->end; n++) {
+        const TunePosition* p = &set->positions[n];
+        double sigmoid = 1.0 / (1.0 + pow(10.0, -s->k * traceEval(set, p, s->params) / 400.0));
+        double diff = p->result * 0.5 - sigmoid;
+        s->error += diff * diff;
+        if (!s->wantGradient)
+            continue;
+
+        // d(diff^2)/d(eval), spread over the phase weights of each entry
+        double g = -2.0 * diff * sigmoid * (1.0 - sigmoid) * scale;
+        double gMg = g * (MAX_PHASE - p->phase) / MAX_PHASE;
+        double gEg = g * p->phase / MAX_PHASE;
+        const TraceEntry* e = set->pool + p->offset;
+        for (int i = 0; i < p->count; i++) {
+            s->gradient[e[i].index] += gMg * e[i].mg + gEg * e[i].eg;
+        }
+    }
+    return NULL;
+}
+
+// Mean squared error over the set; adds the mean gradient to gradient if given.
+static double tuneError(const TuneSet* set, const double* params, double k, int threads,
+                        TuneSlice* slices, double* gradient) {
+    pthread_t tids[threads];
+    bool spawned[threads];
+    size_t chunk = (set->count + (size_t)threads - 1) / (size_t)threads;
+    for (int t = 0; t < threads; t++) {
+        TuneSlice* s = &slices[t];
+        s->set = set;
+        s->params = params;
+        s->k = k;
+        s->wantGradient = gradient != NULL;
+        s->begin = (size_t)t * chunk < set->count ? (size_t)t * chunk : set->count;
+        s->end = s->begin + chunk < set->count ? s->begin + chunk : set->count;
+        spawned[t] = t > 0 && pthread_create(&tids[t], NULL, tuneSlice, s) == 0;
+        if (!spawned[t])
+            tuneSlice(s);
+    }
+
+    double error = 0.0;
+    for (int t = 0; t < threads; t++) {
+        if (spawned[t]) pthread_join(tids[t], NULL);
+        error += slices[t].error;
+        if (gradient) {
+            for (int i = 0; i < TUNE_PARAMS; i++) {
+                gradient[i] += slices[t].gradient[i] / (double)set->count;
+            }
+        }
+    }
+    return error / (double)set->count;
+}
+
+// K minimising the error of the starting parameters (ternary search).
+static double fitK(const TuneSet* set, const double* params, int threads, TuneSlice* slices) {
+    double lo = 0.1, hi = 4.0;
+    for (int i = 0; i < 40; i++) {
+        double a = lo + (hi - lo) / 3.0, b = hi - (hi - lo) / 3.0;
+        if (tuneError(set, params, a, threads, slices, NULL) < tuneError(set, params, b, threads, slices, NULL))
+            hi = b;
+        else
+            lo = a;
+    }
+    return (lo + hi) / 2.0;
+}
+
+int runTune(int argc, char** argv) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: chess tune <data> [epochs N] [lr X] [threads N] [limit N] [out FILE]\n");
+        return 1;
+    }
+
+    int epochs = 1000;
+    double lr = 1.0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    size_t limit = (size_t)-1;
+    const char* outPath = "tuned.eval";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "epochs"))       epochs = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "lr"))      lr = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "threads")) threads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "limit"))   limit = (size_t)atoll(argv[i + 1]);
+        else if (!strcmp(argv[i], "out"))     outPath = argv[i + 1];
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    TuneSet set;
+    memset(&set, 0, sizeof(set));
+    const char* ext = strrchr(argv[0], '.');
+    bool ok = (ext && !strcmp(ext, ".bin")) ? loadPacked(&set, argv[0], limit)
+                                            : loadText(&set, argv[0], limit);
+    if (!ok || set.count == 0) {
+        fprintf(stderr, "no positions loaded from %s\n", argv[0]);
+        return 1;
+    }
+    fprintf(stderr, "%zu positions, %.1f MB of traces", set.count,
+            (set.count * sizeof(TunePosition) + set.poolCount * sizeof(TraceEntry)) / 1048576.0);
+    if (set.mismatches)
+        fprintf(stderr, ", %zu skipped (trace differs from evaluate())", set.mismatches);
+    fprintf(stderr, "\n");
+
+    static double params[TUNE_PARAMS];
+    int* values = (int*)&evalParams;
+    for (int i = 0; i < TUNE_PARAMS; i++) {
+        params[i] = values[i];
+    }
+
+    TuneSlice* slices = (TuneSlice*) calloc((size_t)threads, sizeof(TuneSlice));
+    double k = fitK(&set, params, threads, slices);
+    double error = tuneError(&set, params, k, threads, slices, NULL);
+    fprintf(stderr, "K = %.4f, initial error %.6f\n", k, error);
+
+    // Adam
+    static double m[TUNE_PARAMS], v[TUNE_PARAMS], gradient[TUNE_PARAMS];
+    const double beta1 = 0.9, beta2 = 0.999, eps = 1e-8;
+    memset(m, 0, sizeof(m));
+    memset(v, 0, sizeof(v));
+
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        memset(gradient, 0, sizeof(gradient));
+        error = tuneError(&set, params, k, threads, slices, gradient);
+
+        double c1 = 1.0 - pow(beta1, epoch), c2 = 1.0 - pow(beta2, epoch);
+        for (int i = 0; i < TUNE_PARAMS; i++) {
+            m[i] = beta1 * m[i] + (1.0 - beta1) * gradient[i];
+            v[i] = beta2 * v[i] + (1.0 - beta2) * gradient[i] * gradient[i];
+            params[i] -= lr * (m[i] / c1) / (sqrt(v[i] / c2) + eps);
+        }
+        if (epoch % 50 == 0 || epoch == epochs)
+            fprintf(stderr, "epoch %d error %.6f\n", epoch, error);
+    }
+    error = tuneError(&set, params, k, threads, slices, NULL);
+
+    EvalParams tuned = evalParams;
+    int* tunedValues = (int*)&tuned;
+    for (int i = 0; i < TUNE_PARAMS; i++) {
+        tunedValues[i] = (int)lround(params[i]);
+    }
+    bool saved = false;
+    if (!evalParamsValid(&tuned)) {
+        fprintf(stderr, "final error %.6f, tuned parameters leave the int16 range of packed scores; %s not written\n",
+                error, outPath);
+    } else {
+        evalParams = tuned;
+        evalPrepare();
+        saved = evalSaveParams(outPath);
+        if (saved)
+            fprintf(stderr, "final error %.6f, parameters written to %s\n", error, outPath);
+        else
+            fprintf(stderr, "cannot create %s\n", outPath);
+    }
+
+    free(slices);
+    free(set.positions);
+    free(set.pool);
+    return saved ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""MultiPV lines come out ranked.
+
+    tests/test_multipv.py [ENGINE]
+
+Searches a few positions with MultiPV and checks, for every completed
+depth, that the lines are reported with non-increasing scores and that
+bestmove is the first move of line 1. ENGINE defaults to ./chess.
+"""
+
+import subprocess
+import sys
+
+# (position, MultiPV, depth)
+POSITIONS = [
+    ("startpos", 4, 7),
+    ("fen r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3", 4, 7),
+    ("fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 7),
+    ("fen 8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 7),
+    ("fen 6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1", 4, 7),        # back-rank mate in one
+    # later lines used to come back above earlier ones here
+    ("fen 8/8/8/3K4/8/3k4/8/5r2 b - - 1 1", 8, 5),
+    ("fen 8/8/4r3/6K1/8/2k5/8/8 b - - 43 1", 30, 5),
+]
+MATE = 100000
+
+
+def score_value(words):
+    kind, value = words[words.index("score") + 1:words.index("score") + 3]
+    value = int(value)
+    if kind == "mate":
+        return MATE - value if value > 0 else -MATE - value
+    return value
+
+
+def check_position(engine, position, multipv, depth):
+    commands = "setoption name MultiPV value %d\nposition %s\ngo depth %d\n" % (multipv, position, depth)
+    out = subprocess.run([engine], input=commands, capture_output=True, text=True,
+                         timeout=120, check=True).stdout
+
+    lines = {}                      # depth -> [(multipv, score, first move)]
+    bestmove = None
+    for line in out.splitlines():
+        words = line.split()
+        if words[:2] == ["info", "depth"] and "multipv" in words:
+            depth = int(words[2])
+            pv = words[words.index("pv") + 1] if "pv" in words else None
+            lines.setdefault(depth, []).append(
+                (int(words[words.index("multipv") + 1]), score_value(words), pv))
+        elif words[:1] == ["bestmove"]:
+            bestmove = words[1]
+
+    errors = []
+    if not lines:
+        errors.append("no info lines")
+    for depth, report in sorted(lines.items()):
+        scores = [score for _, score, _ in sorted(report)]
+        if any(a < b for a, b in zip(scores, scores[1:])):
+            errors.append("depth %d: scores %s are not non-increasing" % (depth, scores))
+    if lines:
+        last = sorted(lines[max(lines)])
+        if last[0][2] != bestmove:
+            errors.append("bestmove %s is not the first move of multipv 1 (%s)" % (bestmove, last[0][2]))
+    return errors
+
+
+def main():
+    engine = sys.argv[1] if len(sys.argv) > 1 else "./chess"
+    failed = 0
+    for position, multipv, depth in POSITIONS:
+        errors = check_position(engine, position, multipv, depth)
+        print("%s %s" % ("FAIL" if errors else "ok  ", position))
+        for error in errors:
+            print("    " + error)
+        failed += bool(errors)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""PGN movetext oddities replay without hanging.
+
+    tests/test_pgn.py [ENGINE]
+
+Replays small games through "chess pgn FILE" and checks how many plies
+were read, so a tokenizer that stops advancing shows up as a timeout and
+one that drops moves as a short count. ENGINE defaults to ./chess.
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+# (movetext, plies of the main line); a '}' without '{' used to hang
+GAMES = [
+    ("1. e4 } e5 *", 2),
+    ("1. e4 e5 2. Nf3 }} Nc6 *", 4),
+    ("1. e4 {a comment} e5 (1... c5 }) 2. Nf3 *", 3),
+]
+
+
+def replay(engine, movetext):
+    with tempfile.NamedTemporaryFile("w", suffix=".pgn", delete=False) as f:
+        f.write('[Event "test"]\n[Result "*"]\n\n%s\n' % movetext)
+        path = f.name
+    try:
+        report = subprocess.run([engine, "pgn", path], capture_output=True, text=True,
+                                timeout=10, check=True).stderr.split()
+    except subprocess.TimeoutExpired:
+        return None, "timed out"
+    finally:
+        os.unlink(path)
+    # "1 games, N plies in ..., 0 games with unreadable moves"
+    if "plies" not in report or report[report.index("with") - 2] != "0":
+        return None, "unreadable: %s" % " ".join(report)
+    return int(report[report.index("plies") - 1]), None
+
+
+def main():
+    engine = sys.argv[1] if len(sys.argv) > 1 else "./chess"
+    failed = 0
+    for movetext, expected in GAMES:
+        plies, error = replay(engine, movetext)
+        if not error and plies != expected:
+            error = "%d plies, expected %d" % (plies, expected)
+        print("%s %s" % ("FAIL" if error else "ok  ", movetext))
+        if error:
+            print("    " + error)
+        failed += bool(error)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Syzygy probes against real tables.
+
+    tests/test_syzygy.py [ENGINE] [SYZYGY_PATH]
+
+Probes positions with known values (the "tbprobe" command) and checks the
+WDL and DTZ values and the root move the search takes. It needs the 3-piece
+KQvK, KRvK and KPvK tables (.rtbw and .rtbz), e.g. from
+https://tablebase.lichess.ovh/tables/standard/3-4-5/, and an engine built
+with make SYZYGY=1. The path comes from the second argument or
+$SYZYGY_PATH; without it, or when the tables are not found there, the test
+fails rather than passing unchecked. ENGINE defaults to ./chess.
+"""
+
+import os
+import subprocess
+import sys
+
+TABLES = ["KQvK", "KRvK", "KPvK"]
+
+# (FEN, WDL, DTZ, bestmove); DTZ None only checks its sign against WDL.
+# WDL and DTZ are from the side to move; a DTZ of 1 is a win by a mate or
+# a zeroing move next.
+POSITIONS = [
+    ("7k/8/5K2/8/8/8/8/6Q1 w - - 0 1", 2, 1, "g1g7"),        # KQvK, Qg7 mates
+    ("4k3/8/8/8/8/8/8/3QK3 w - - 0 1", 2, None, None),      # KQvK, won
+    ("k7/8/1K6/8/8/8/8/7R w - - 0 1", 2, 1, "h1h8"),        # KRvK, Rh8 mates
+    ("k7/8/1K6/8/8/8/8/7R b - - 0 1", -2, None, "a8b8"),    # KRvK, mated next move
+    ("4k3/8/8/8/8/8/8/R3K3 b - - 0 1", -2, None, None),     # KRvK, lost
+    ("8/P7/8/8/8/8/8/K6k w - - 0 1", 2, 1, "a7a8q"),        # KPvK, promotes
+    ("8/1k6/8/8/8/8/P7/K7 w - - 0 1", 0, 0, None),          # KPvK, rook pawn, king in time
+    ("8/8/8/8/8/8/8/K1k4r w - - 0 1", None, None, None),    # KRvK with the rook
+]
+
+
+def tables_present(path):
+    for directory in path.split(":"):
+        if all(os.path.exists(os.path.join(directory, t + ext)) for t in TABLES for ext in (".rtbw", ".rtbz")):
+            return True
+    return False
+
+
+def run(engine, path, fen):
+    commands = ("setoption name SyzygyPath value %s\nposition fen %s\ntbprobe\ngo depth 3\n" % (path, fen))
+    out = subprocess.run([engine], input=commands, capture_output=True, text=True,
+                         timeout=60, check=True).stdout
+    probe = bestmove = None
+    for line in out.splitlines():
+        if line.startswith("info string tbprobe"):
+            probe = line.split()[3:]
+        elif line.startswith("bestmove"):
+            bestmove = line.split()[1]
+    return probe, bestmove
+
+
+def check(engine, path, fen, wdl, dtz, move):
+    probe, bestmove = run(engine, path, fen)
+    if not probe or probe[0] != "wdl":
+        return ["probe failed: %s" % (" ".join(probe) if probe else "no tbprobe output")]
+    got_wdl = int(probe[1])
+    got_dtz = None if probe[3] == "none" else int(probe[3])
+
+    errors = []
+    if got_dtz is None:
+        errors.append("no DTZ value")
+    if wdl is None:                                  # only the two values must agree
+        wdl = got_wdl
+    if got_wdl != wdl:
+        errors.append("wdl %d, expected %d" % (got_wdl, wdl))
+    if got_dtz is not None:
+        if dtz is not None and got_dtz != dtz:
+            errors.append("dtz %d, expected %d" % (got_dtz, dtz))
+        if (got_dtz > 0) != (wdl > 0) or (got_dtz < 0) != (wdl < 0):
+            errors.append("dtz %d does not match wdl %d" % (got_dtz, wdl))
+    if move and bestmove != move:
+        errors.append("bestmove %s, expected %s" % (bestmove, move))
+    return errors
+
+
+def main():
+    engine = sys.argv[1] if len(sys.argv) > 1 else "./chess"
+    path = sys.argv[2] if len(sys.argv) > 2 else os.environ.get("SYZYGY_PATH", "")
+    if not path or not tables_present(path):
+        print("FAIL no %s tables (.rtbw and .rtbz) in SYZYGY_PATH" % ", ".join(TABLES))
+        return 1
+
+    failed = 0
+    for fen, wdl, dtz, move in POSITIONS:
+        errors = check(engine, path, fen, wdl, dtz, move)
+        print("%s %s" % ("FAIL" if errors else "ok  ", fen))
+        for error in errors:
+            print("    " + error)
+        failed += bool(errors)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())